@@ -141,6 +141,8 @@ static void sync_to_current(ScintillaObject *sci, ScintillaObject *current)
 	/* override some defaults */
 	set_line_numbers(sci, geany->editor_prefs->show_linenumber_margin);
 	scintilla_send_message(sci, SCI_SETMARGINWIDTHN, 1, 0 ); /* hide marker margin (no commands) */
+	/* only margin clicks are handled so don't send modification notifications */
+	scintilla_send_message(sci, SCI_SETMODEVENTMASK, 0, 0);
 }
 
 
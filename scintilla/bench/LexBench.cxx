@@ -0,0 +1,433 @@
+// Scintilla source code edit control
+/** @file LexBench.cxx
+ ** Measures the throughput of every lexer without a platform layer.
+ **/
+// Copyright 1998-2011 by Neil Hodgson <neilh@scintilla.org>
+// The License.txt file describes the conditions under which this software may be distributed.
+
+// Usage: lexbench [-r repeats] [-e edits] [-l lexer]... file...
+// Each selected lexer lexes and folds the concatenated files, then restyles after
+// single character insertions as an editor would after typing. Results are written
+// to stdout as tab separated values, one line per lexer after a header line. A rate
+// is n/a when its time is below the resolution of the timer, or for folding when the
+// lexer's Fold sets no fold levels.
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+#include <new>
+
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "ILexer.h"
+#include "Scintilla.h"
+#include "SciLexer.h"
+
+#include "LexerModule.h"
+#include "Catalogue.h"
+
+#ifdef SCI_NAMESPACE
+using namespace Scintilla;
+#endif
+
+// Count allocations made while lexing by replacing the global allocation functions
+#if __cplusplus >= 201103L
+#define THROWS_BAD_ALLOC
+#define THROWS_NOTHING noexcept
+#else
+#define THROWS_BAD_ALLOC throw(std::bad_alloc)
+#define THROWS_NOTHING throw()
+#endif
+
+static size_t allocations = 0;
+static size_t allocatedBytes = 0;
+
+void *operator new(size_t size) THROWS_BAD_ALLOC {
+	allocations++;
+	allocatedBytes += size;
+	void *p = malloc(size ? size : 1);
+	if (!p)
+		throw std::bad_alloc();
+	return p;
+}
+
+void *operator new(size_t size, const std::nothrow_t &) THROWS_NOTHING {
+	try {
+		return operator new(size);
+	} catch (std::bad_alloc &) {
+		return 0;
+	}
+}
+
+void operator delete(void *p) THROWS_NOTHING {
+	free(p);
+}
+
+void operator delete(void *p, const std::nothrow_t &) THROWS_NOTHING {
+	operator delete(p);
+}
+
+void *operator new[](size_t size) THROWS_BAD_ALLOC {
+	return operator new(size);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) THROWS_NOTHING {
+	return operator new(size, std::nothrow);
+}
+
+void operator delete[](void *p) THROWS_NOTHING {
+	operator delete(p);
+}
+
+void operator delete[](void *p, const std::nothrow_t &) THROWS_NOTHING {
+	operator delete(p);
+}
+
+#if __cplusplus >= 201402L
+// Called instead of the unsized forms when sized deallocation is enabled
+void operator delete(void *p, size_t) THROWS_NOTHING {
+	operator delete(p);
+}
+
+void operator delete[](void *p, size_t) THROWS_NOTHING {
+	operator delete(p);
+}
+#endif
+
+/**
+ * Just enough of a document for lexers: text in a gap buffer so that lexers see
+ * the same two segments as with Document, with styles, line starts, fold levels
+ * and line states.
+ */
+class BenchDocument : public IDocumentWithSegments {
+	std::vector<char> body;
+	int gap;
+	int gapLength;
+	std::vector<char> styles;
+	std::vector<int> lineStarts;
+	std::vector<int> levels;
+	std::vector<int> lineStates;
+	int endStyled;
+	char stylingMask;
+	int levelsSet;
+
+	void GapTo(int position) {
+		if (position < gap) {
+			memmove(&body[0] + position + gapLength, &body[0] + position, gap - position);
+		} else if (position > gap) {
+			memmove(&body[0] + gap, &body[0] + gap + gapLength, position - gap);
+		}
+		gap = position;
+	}
+public:
+	explicit BenchDocument(const std::string &text) :
+		gap(static_cast<int>(text.length())), gapLength(0), endStyled(0), stylingMask(0), levelsSet(0) {
+		body.assign(text.begin(), text.end());
+		styles.assign(text.length(), 0);
+		lineStarts.push_back(0);
+		for (size_t i = 0; i < text.length(); i++) {
+			if ((text[i] == '\n') || ((text[i] == '\r') && ((i + 1 == text.length()) || (text[i + 1] != '\n'))))
+				lineStarts.push_back(static_cast<int>(i + 1));
+		}
+		levels.assign(lineStarts.size() + 1, SC_FOLDLEVELBASE);
+		lineStates.assign(lineStarts.size() + 1, 0);
+	}
+	virtual ~BenchDocument() {
+	}
+
+	/// Number of calls to SetLevel, so a fold pass that does nothing can be recognised.
+	int LevelsSet() const {
+		return levelsSet;
+	}
+
+	/// Insert a character that is not a line end, leaving its style 0.
+	void InsertChar(int position, char ch) {
+		if (gapLength == 0) {
+			gapLength = 4096;
+			body.insert(body.begin() + gap, gapLength, '\0');
+		}
+		GapTo(position);
+		body[gap] = ch;
+		gap++;
+		gapLength--;
+		styles.insert(styles.begin() + position, 0);
+		for (size_t line = LineFromPosition(position) + 1; line < lineStarts.size(); line++)
+			lineStarts[line]++;
+	}
+
+	int SCI_METHOD Version() const {
+		return dvSegments;
+	}
+	void SCI_METHOD SetErrorStatus(int) {
+	}
+	int SCI_METHOD Length() const {
+		return static_cast<int>(styles.size());
+	}
+	void SCI_METHOD GetCharRange(char *buffer, int position, int lengthRetrieve) const {
+		for (int i = 0; i < lengthRetrieve; i++) {
+			int pos = position + i;
+			buffer[i] = body[(pos < gap) ? pos : pos + gapLength];
+		}
+	}
+	char SCI_METHOD StyleAt(int position) const {
+		if ((position < 0) || (position >= Length()))
+			return 0;
+		return styles[position];
+	}
+	int SCI_METHOD LineFromPosition(int position) const {
+		return static_cast<int>(std::upper_bound(lineStarts.begin(), lineStarts.end(), position) - lineStarts.begin()) - 1;
+	}
+	int SCI_METHOD LineStart(int line) const {
+		if (line < 0)
+			return 0;
+		if (line >= static_cast<int>(lineStarts.size()))
+			return Length();
+		return lineStarts[line];
+	}
+	int SCI_METHOD GetLevel(int line) const {
+		if ((line < 0) || (line >= static_cast<int>(levels.size())))
+			return SC_FOLDLEVELBASE;
+		return levels[line];
+	}
+	int SCI_METHOD SetLevel(int line, int level) {
+		levelsSet++;
+		if ((line < 0) || (line >= static_cast<int>(levels.size())))
+			return SC_FOLDLEVELBASE;
+		int prev = levels[line];
+		levels[line] = level;
+		return prev;
+	}
+	int SCI_METHOD GetLineState(int line) const {
+		if ((line < 0) || (line >= static_cast<int>(lineStates.size())))
+			return 0;
+		return lineStates[line];
+	}
+	int SCI_METHOD SetLineState(int line, int state) {
+		if ((line < 0) || (line >= static_cast<int>(lineStates.size())))
+			return 0;
+		int prev = lineStates[line];
+		lineStates[line] = state;
+		return prev;
+	}
+	void SCI_METHOD StartStyling(int position, char mask) {
+		stylingMask = mask;
+		endStyled = position;
+	}
+	bool SCI_METHOD SetStyleFor(int length, char style) {
+		style &= stylingMask;
+		for (int i = 0; (i < length) && (endStyled < Length()); i++, endStyled++)
+			styles[endStyled] = static_cast<char>((styles[endStyled] & ~stylingMask) | style);
+		return true;
+	}
+	bool SCI_METHOD SetStyles(int length, const char *stylesNew) {
+		for (int i = 0; (i < length) && (endStyled < Length()); i++, endStyled++)
+			styles[endStyled] = static_cast<char>((styles[endStyled] & ~stylingMask) | (stylesNew[i] & stylingMask));
+		return true;
+	}
+	void SCI_METHOD DecorationSetCurrentIndicator(int) {
+	}
+	void SCI_METHOD DecorationFillRange(int, int, int) {
+	}
+	void SCI_METHOD ChangeLexerState(int, int) {
+	}
+	int SCI_METHOD CodePage() const {
+		return SC_CP_UTF8;
+	}
+	bool SCI_METHOD IsDBCSLeadByte(char) const {
+		return false;
+	}
+	const char * SCI_METHOD BufferPointer() {
+		GapTo(Length());
+		if (gapLength == 0) {
+			body.push_back('\0');
+			gapLength = 1;
+		}
+		body[gap] = '\0';
+		return &body[0];
+	}
+	int SCI_METHOD GetLineIndentation(int line) {
+		int indent = 0;
+		for (int pos = LineStart(line); pos < Length(); pos++) {
+			char ch = body[(pos < gap) ? pos : pos + gapLength];
+			if (ch == ' ')
+				indent++;
+			else if (ch == '\t')
+				indent = ((indent / 8) + 1) * 8;
+			else
+				break;
+		}
+		return indent;
+	}
+	void SCI_METHOD GetSegments(const char **segment1, int *length1, const char **segment2, int *length2) {
+		*segment1 = body.empty() ? 0 : &body[0];
+		*length1 = gap;
+		*segment2 = body.empty() ? 0 : &body[0] + gap + gapLength;
+		*length2 = Length() - gap;
+	}
+};
+
+// Common words so that keyword lookups happen in most languages
+static const char benchKeywords[] =
+	"and begin break case char class const continue def do double else elif end "
+	"for function if import in int let local not or return static struct then "
+	"type var void while";
+
+static double Seconds(clock_t start) {
+	return static_cast<double>(clock() - start) / CLOCKS_PER_SEC;
+}
+
+// The smallest step in which clock() advances.
+static double TimerResolution() {
+	clock_t tick = clock();
+	while (clock() == tick)
+		;
+	tick = clock();
+	clock_t next;
+	while ((next = clock()) == tick)
+		;
+	return static_cast<double>(next - tick) / CLOCKS_PER_SEC;
+}
+
+static double timerResolution = 0.0;
+
+// Times below the resolution of the timer are noise, so print n/a instead of a rate.
+static void PrintRate(size_t bytes, double seconds, bool measured) {
+	if (measured && (seconds >= timerResolution))
+		printf("\t%.2f", bytes / seconds / 1.0e6);
+	else
+		printf("\tn/a");
+}
+
+static ILexer *CreateLexer(const LexerModule *plm) {
+	ILexer *lexer = plm->Create();
+	lexer->PropertySet("fold", "1");
+	lexer->PropertySet("fold.compact", "1");
+	lexer->PropertySet("fold.comment", "1");
+	lexer->PropertySet("fold.preprocessor", "1");
+	lexer->PropertySet("fold.html", "1");
+	for (int n = 0; n < plm->GetNumWordLists(); n++)
+		lexer->WordListSet(n, benchKeywords);
+	return lexer;
+}
+
+static void Bench(const LexerModule *plm, const std::string &text, int repeats, int edits) {
+	const int styleMask = (1 << plm->GetStyleBitsNeeded()) - 1;
+	const int length = static_cast<int>(text.length());
+	double bestLex = 0.0;
+	double bestFold = 0.0;
+	size_t passAllocations = 0;
+	size_t passBytes = 0;
+	bool folds = false;
+	for (int r = 0; r < repeats; r++) {
+		BenchDocument doc(text);
+		ILexer *lexer = CreateLexer(plm);
+		const size_t allocationsBefore = allocations;
+		const size_t bytesBefore = allocatedBytes;
+		clock_t start = clock();
+		lexer->Lex(0, length, 0, &doc);
+		double lexTime = Seconds(start);
+		const int levelsBefore = doc.LevelsSet();
+		start = clock();
+		lexer->Fold(0, length, 0, &doc);
+		double foldTime = Seconds(start);
+		folds = doc.LevelsSet() > levelsBefore;
+		passAllocations = allocations - allocationsBefore;
+		passBytes = allocatedBytes - bytesBefore;
+		if ((r == 0) || (lexTime < bestLex))
+			bestLex = lexTime;
+		if ((r == 0) || (foldTime < bestFold))
+			bestFold = foldTime;
+		lexer->Release();
+	}
+
+	// Insert characters at scattered positions and restyle a screenful of lines from
+	// the start of each changed line.
+	BenchDocument doc(text);
+	ILexer *lexer = CreateLexer(plm);
+	lexer->Lex(0, length, 0, &doc);
+	lexer->Fold(0, length, 0, &doc);
+	const int linesRestyled = 60;
+	double editTime = 0.0;
+	size_t editBytes = 0;
+	size_t editAllocations = 0;
+	unsigned int seed = 1;
+	for (int e = 0; (e < edits) && (length > 0); e++) {
+		seed = seed * 1103515245 + 12345;
+		int position = static_cast<int>((seed >> 8) % doc.Length());
+		doc.InsertChar(position, 'x');
+		int line = doc.LineFromPosition(position);
+		int startPos = doc.LineStart(line);
+		int endPos = doc.LineStart(line + linesRestyled);
+		int initStyle = (startPos > 0) ? (doc.StyleAt(startPos - 1) & styleMask) : 0;
+		const size_t allocationsBefore = allocations;
+		clock_t start = clock();
+		lexer->Lex(startPos, endPos - startPos, initStyle, &doc);
+		lexer->Fold(startPos, endPos - startPos, initStyle, &doc);
+		editTime += Seconds(start);
+		editAllocations += allocations - allocationsBefore;
+		editBytes += endPos - startPos;
+	}
+	lexer->Release();
+
+	printf("%s\t%d", plm->languageName ? plm->languageName : "?", length);
+	PrintRate(length, bestLex, true);
+	PrintRate(length, bestFold, folds);
+	PrintRate(editBytes, editTime, true);
+	printf("\t%d\t%.1f\t%lu\t%lu\t%lu\n",
+		edits,
+		(edits > 0) ? editTime * 1.0e6 / edits : 0.0,
+		static_cast<unsigned long>(passAllocations),
+		static_cast<unsigned long>(passBytes),
+		static_cast<unsigned long>(editAllocations));
+	fflush(stdout);
+}
+
+static bool ReadFile(const char *name, std::string &text) {
+	FILE *fp = fopen(name, "rb");
+	if (!fp)
+		return false;
+	char buffer[0x10000];
+	size_t lenBlock;
+	while ((lenBlock = fread(buffer, 1, sizeof(buffer), fp)) > 0)
+		text.append(buffer, lenBlock);
+	fclose(fp);
+	return true;
+}
+
+int main(int argc, char *argv[]) {
+	int repeats = 3;
+	int edits = 200;
+	std::vector<std::string> names;
+	std::string text;
+	for (int i = 1; i < argc; i++) {
+		if ((0 == strcmp(argv[i], "-r")) && (i + 1 < argc)) {
+			repeats = Maximum(atoi(argv[++i]), 1);
+		} else if ((0 == strcmp(argv[i], "-e")) && (i + 1 < argc)) {
+			edits = Maximum(atoi(argv[++i]), 0);
+		} else if ((0 == strcmp(argv[i], "-l")) && (i + 1 < argc)) {
+			names.push_back(argv[++i]);
+		} else if (!ReadFile(argv[i], text)) {
+			fprintf(stderr, "lexbench: can not read %s\n", argv[i]);
+			return 1;
+		}
+	}
+	if (text.empty()) {
+		fprintf(stderr, "usage: lexbench [-r repeats] [-e edits] [-l lexer]... file...\n");
+		return 1;
+	}
+
+	timerResolution = TimerResolution();
+	printf("lexer\tbytes\tlex_mb_s\tfold_mb_s\trestyle_mb_s\tedits\tus_per_edit\t"
+		"allocations\tallocated_bytes\tedit_allocations\n");
+	for (int i = 0; i < Catalogue::Count(); i++) {
+		const LexerModule *plm = Catalogue::At(i);
+		if (!names.empty() && (!plm->languageName ||
+			(std::find(names.begin(), names.end(), plm->languageName) == names.end())))
+			continue;
+		Bench(plm, text, repeats, edits);
+	}
+	return 0;
+}
@@ -0,0 +1,116 @@
+// Scintilla source code edit control
+/** @file LoadBench.cxx
+ ** Measures how quickly text is loaded into a document.
+ **/
+// Copyright 1998-2011 by Neil Hodgson <neilh@scintilla.org>
+// The License.txt file describes the conditions under which this software may be distributed.
+
+// Usage: loadbench [-r repeats] [-g megabytes] file...
+// The concatenated files, or generated lines when -g is used, are inserted into an
+// empty document with undo collection off as SCI_SETTEXT does when a file is opened.
+// Results are written to stdout as tab separated values after a header line.
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+
+#include <string>
+#include <vector>
+
+#include "Platform.h"
+
+#include "ILexer.h"
+#include "Scintilla.h"
+
+#include "SplitVector.h"
+#include "Partitioning.h"
+#include "RunStyles.h"
+#include "CellBuffer.h"
+#include "PerLine.h"
+#include "CharClassify.h"
+#include "Decoration.h"
+#include "Document.h"
+
+#ifdef SCI_NAMESPACE
+using namespace Scintilla;
+#endif
+
+static double Seconds(clock_t start) {
+	return static_cast<double>(clock() - start) / CLOCKS_PER_SEC;
+}
+
+static double MBPerSecond(size_t bytes, double seconds) {
+	return (seconds > 0.0) ? bytes / seconds / 1.0e6 : 0.0;
+}
+
+static bool ReadFile(const char *name, std::string &text) {
+	FILE *fp = fopen(name, "rb");
+	if (!fp)
+		return false;
+	char buffer[0x10000];
+	size_t lenBlock;
+	while ((lenBlock = fread(buffer, 1, sizeof(buffer), fp)) > 0)
+		text.append(buffer, lenBlock);
+	fclose(fp);
+	return true;
+}
+
+// Lines of varying length that look a little like source code
+static void Generate(std::string &text, size_t megabytes) {
+	static const char *words[] = {
+		"int", "value", "=", "count", "+", "1;", "if", "(name)", "{", "}", "return", "result;"
+	};
+	const size_t length = megabytes * 1000000;
+	unsigned int seed = 1;
+	while (text.length() < length) {
+		seed = seed * 1103515245 + 12345;
+		int wordsInLine = (seed >> 16) % 12;
+		text.append((seed >> 8) % 4, '\t');
+		for (int w = 0; w < wordsInLine; w++) {
+			seed = seed * 1103515245 + 12345;
+			text.append(words[(seed >> 16) % (sizeof(words) / sizeof(words[0]))]);
+			text.append(" ");
+		}
+		text.append("\n");
+	}
+}
+
+int main(int argc, char *argv[]) {
+	int repeats = 3;
+	std::string text;
+	for (int i = 1; i < argc; i++) {
+		if ((0 == strcmp(argv[i], "-r")) && (i + 1 < argc)) {
+			repeats = Platform::Maximum(atoi(argv[++i]), 1);
+		} else if ((0 == strcmp(argv[i], "-g")) && (i + 1 < argc)) {
+			Generate(text, atoi(argv[++i]));
+		} else if (!ReadFile(argv[i], text)) {
+			fprintf(stderr, "loadbench: can not read %s\n", argv[i]);
+			return 1;
+		}
+	}
+	if (text.empty()) {
+		fprintf(stderr, "usage: loadbench [-r repeats] [-g megabytes] file...\n");
+		return 1;
+	}
+
+	const int length = static_cast<int>(text.length());
+	double bestLoad = 0.0;
+	int lines = 0;
+	for (int r = 0; r < repeats; r++) {
+		Document *pdoc = new Document();
+		pdoc->AddRef();
+		pdoc->SetUndoCollection(false);
+		clock_t start = clock();
+		pdoc->InsertString(0, text.c_str(), length);
+		double loadTime = Seconds(start);
+		lines = pdoc->LinesTotal();
+		pdoc->Release();
+		if ((r == 0) || (loadTime < bestLoad))
+			bestLoad = loadTime;
+	}
+
+	printf("bytes\tlines\tload_s\tload_mb_s\n");
+	printf("%d\t%d\t%.3f\t%.2f\n", length, lines, bestLoad, MBPerSecond(length, bestLoad));
+	return 0;
+}
@@ -140,6 +140,8 @@ static void FontMutexUnlock() {
 #endif
 }
 
+class FontCached;
+
 // On GTK+ 1.x holds a GdkFont* but on GTK+ 2.x can hold a GdkFont* or a
 // PangoFontDescription*.
 class FontHandle {
@@ -147,19 +149,23 @@ class FontHandle {
 	encodingType et;
 public:
 	int ascent;
+	int descent;
+	FontCached *cached;
 #ifndef DISABLE_GDK_FONT
 	GdkFont *pfont;
 #endif
 	PangoFontDescription *pfd;
 	int characterSet;
 #ifdef DISABLE_GDK_FONT
-	FontHandle() : et(singleByte), ascent(0), pfd(0), characterSet(-1) {
+	FontHandle() : et(singleByte), ascent(0), descent(0), cached(0), pfd(0), characterSet(-1) {
 		ResetWidths(et);
 	}
 #else
 	FontHandle(GdkFont *pfont_=0) {
 		et = singleByte;
 		ascent = 0;
+		descent = 0;
+		cached = 0;
 		pfont = pfont_;
 		pfd = 0;
 		characterSet = -1;
@@ -169,6 +175,8 @@ public:
 	FontHandle(PangoFontDescription *pfd_, int characterSet_) {
 		et = singleByte;
 		ascent = 0;
+		descent = 0;
+		cached = 0;
 #ifndef DISABLE_GDK_FONT
 		pfont = 0;
 #endif
@@ -457,39 +465,56 @@ static void SetLogFont(LOGFONT &lf, const char *faceName, int characterSet, int
  * If one font is the same as another, its hash will be the same, but if the hash is the
  * same then they may still be different.
  */
-static int HashFont(const char *faceName, int characterSet, int size, bool bold, bool italic) {
-	return
+static unsigned int HashFont(const char *faceName, int characterSet, int size, bool bold, bool italic) {
+	unsigned int hash =
 	    size ^
 	    (characterSet << 10) ^
 	    (bold ? 0x10000000 : 0) ^
-	    (italic ? 0x20000000 : 0) ^
-	    faceName[0];
+	    (italic ? 0x20000000 : 0);
+	for (const char *pc = faceName; *pc; pc++) {
+		hash = hash * 31 + static_cast<unsigned char>(*pc);
+	}
+	return hash;
 }
 
+/**
+ * Fonts are shared through a hash table and reference counted.
+ * Styles are refreshed, for example when zooming, by releasing all their fonts then
+ * creating mostly the same fonts again so a few fonts that are no longer used are
+ * retained along with their measured metrics.
+ */
 class FontCached : Font {
 	FontCached *next;
 	int usage;
 	LOGFONT lf;
-	int hash;
+	unsigned int hash;
 	FontCached(const char *faceName_, int characterSet_, int size_, bool bold_, bool italic_);
 	~FontCached() {}
 	bool SameAs(const char *faceName_, int characterSet_, int size_, bool bold_, bool italic_);
 	virtual void Release();
 	static FontID CreateNewFont(const char *fontName, int characterSet,
 	                            int size, bool bold, bool italic);
-	static FontCached *first;
+	static void Remove(FontCached *fc);
+	enum { lengthTable = 256 };
+	enum { maxUnused = 32 };
+	static FontCached *table[lengthTable];
+	static int unused;
 public:
 	static FontID FindOrCreate(const char *faceName_, int characterSet_, int size_, bool bold_, bool italic_);
 	static void ReleaseId(FontID fid_);
+	static void ReleaseUnused();
 };
 
-FontCached *FontCached::first = 0;
+FontCached *FontCached::table[FontCached::lengthTable];
+int FontCached::unused = 0;
 
 FontCached::FontCached(const char *faceName_, int characterSet_, int size_, bool bold_, bool italic_) :
 next(0), usage(0), hash(0) {
 	::SetLogFont(lf, faceName_, characterSet_, size_, bold_, italic_);
 	hash = HashFont(faceName_, characterSet_, size_, bold_, italic_);
 	fid = CreateNewFont(faceName_, characterSet_, size_, bold_, italic_);
+	if (fid)
+		PFont(*this)->cached = this;
 	usage = 1;
 }
 
@@ -508,22 +533,40 @@ void FontCached::Release() {
 	fid = 0;
 }
 
+// Unlink from its bucket and destroy. Called with the font mutex held.
+void FontCached::Remove(FontCached *fc) {
+	FontCached **pcur = &table[fc->hash % lengthTable];
+	while (*pcur && (*pcur != fc)) {
+		pcur = &(*pcur)->next;
+	}
+	if (*pcur) {
+		*pcur = fc->next;
+	}
+	fc->Release();
+	fc->next = 0;
+	delete fc;
+}
+
 FontID FontCached::FindOrCreate(const char *faceName_, int characterSet_, int size_, bool bold_, bool italic_) {
 	FontID ret = 0;
 	FontMutexLock();
-	int hashFind = HashFont(faceName_, characterSet_, size_, bold_, italic_);
-	for (FontCached *cur = first; cur; cur = cur->next) {
+	unsigned int hashFind = HashFont(faceName_, characterSet_, size_, bold_, italic_);
+	FontCached **bucket = &table[hashFind % lengthTable];
+	for (FontCached *cur = *bucket; cur; cur = cur->next) {
 		if ((cur->hash == hashFind) &&
 		        cur->SameAs(faceName_, characterSet_, size_, bold_, italic_)) {
+			if (cur->usage == 0)
+				unused--;
 			cur->usage++;
 			ret = cur->fid;
+			break;
 		}
 	}
 	if (ret == 0) {
 		FontCached *fc = new FontCached(faceName_, characterSet_, size_, bold_, italic_);
 		if (fc) {
-			fc->next = first;
-			first = fc;
+			fc->next = *bucket;
+			*bucket = fc;
 			ret = fc->fid;
 		}
 	}
@@ -533,23 +576,41 @@ FontID FontCached::FindOrCreate(const char *faceName_, int characterSet_, int si
 
 void FontCached::ReleaseId(FontID fid_) {
 	FontMutexLock();
-	FontCached **pcur = &first;
-	for (FontCached *cur = first; cur; cur = cur->next) {
-		if (cur->fid == fid_) {
-			cur->usage--;
-			if (cur->usage == 0) {
-				*pcur = cur->next;
-				cur->Release();
-				cur->next = 0;
-				delete cur;
+	FontCached *fc = reinterpret_cast<FontHandle *>(fid_)->cached;
+	if (fc) {
+		fc->usage--;
+		if (fc->usage == 0) {
+			unused++;
+			// Discard another unused font when too many are retained
+			for (int i = 0; (i < lengthTable) && (unused > maxUnused); i++) {
+				for (FontCached *cur = table[i]; cur; cur = cur->next) {
+					if ((cur->usage == 0) && (cur != fc)) {
+						Remove(cur);
+						unused--;
+						break;
+					}
+				}
 			}
-			break;
 		}
-		pcur = &cur->next;
 	}
 	FontMutexUnlock();
 }
 
+void FontCached::ReleaseUnused() {
+	FontMutexLock();
+	for (int i = 0; i < lengthTable; i++) {
+		FontCached *cur = table[i];
+		while (cur) {
+			FontCached *next = cur->next;
+			if (cur->usage == 0)
+				Remove(cur);
+			cur = next;
+		}
+	}
+	unused = 0;
+	FontMutexUnlock();
+}
+
 #ifndef DISABLE_GDK_FONT
 static GdkFont *LoadFontOrSet(const char *fontspec, int characterSet) {
 	if (IsDBCSCharacterSet(characterSet)) {
@@ -1944,7 +2005,13 @@ int SurfaceImpl::WidthText(Font &font_, const char *s, int len) {
 int SurfaceImpl::WidthChar(Font &font_, char ch) {
 	if (font_.GetID()) {
 		if (PFont(font_)->pfd) {
-			return WidthText(font_, &ch, 1);
+			// Widths of ASCII characters are kept with the shared font
+			int width = PFont(font_)->CharWidth(ch, et);
+			if (width == 0) {
+				width = WidthText(font_, &ch, 1);
+				PFont(font_)->SetCharWidth(ch, width, et);
+			}
+			return width;
 		}
 #ifndef DISABLE_GDK_FONT
 		return gdk_char_width(PFont(font_)->pfont, ch);
@@ -2017,10 +2084,16 @@ int SurfaceImpl::Descent(Font &font_) {
 #ifdef FAST_WAY
 
 	if (PFont(font_)->pfd) {
-		PangoFontMetrics *metrics = pango_context_get_metrics(pcontext,
-			PFont(font_)->pfd, pango_context_get_language(pcontext));
-		int descent = PANGO_PIXELS(pango_font_metrics_get_descent(metrics));
-		pango_font_metrics_unref(metrics);
+		FontMutexLock();
+		int descent = PFont(font_)->descent;
+		if (descent == 0) {
+			PangoFontMetrics *metrics = pango_context_get_metrics(pcontext,
+				PFont(font_)->pfd, pango_context_get_language(pcontext));
+			descent = PANGO_PIXELS(pango_font_metrics_get_descent(metrics));
+			pango_font_metrics_unref(metrics);
+			PFont(font_)->descent = descent;
+		}
+		FontMutexUnlock();
 		return descent;
 	}
 #ifndef DISABLE_GDK_FONT
@@ -2296,6 +2369,7 @@ class ListBoxX : public ListBox {
 	int desiredVisibleRows;
 	unsigned int maxItemCharacters;
 	unsigned int aveCharWidth;
+	void AppendToStore(GtkListStore *store, const char *s, int type);
 public:
 	CallBackAction doubleClickAction;
 	void *doubleClickActionData;
@@ -2571,14 +2645,16 @@ static void init_pixmap(ListImage *list_image) {
 #define SPACING 5
 
 void ListBoxX::Append(char *s, int type) {
+	AppendToStore(GTK_LIST_STORE(gtk_tree_view_get_model(GTK_TREE_VIEW(list))), s, type);
+}
+
+void ListBoxX::AppendToStore(GtkListStore *store, const char *s, int type) {
 	ListImage *list_image = NULL;
 	if ((type >= 0) && pixhash) {
 		list_image = (ListImage *) g_hash_table_lookup((GHashTable *) pixhash
 		             , (gconstpointer) GINT_TO_POINTER(type));
 	}
 	GtkTreeIter iter;
-	GtkListStore *store =
-		GTK_LIST_STORE(gtk_tree_view_get_model(GTK_TREE_VIEW(list)));
 	gtk_list_store_append(GTK_LIST_STORE(store), &iter);
 	if (list_image) {
 		if (NULL == list_image->pixbuf)
@@ -2770,7 +2846,14 @@ void ListBoxX::ClearRegisteredImages() {
 }
 
 void ListBoxX::SetList(const char *listText, char separator, char typesep) {
-	Clear();
+	// Fill the store while it is detached from the view as otherwise the view
+	// updates itself for each row removed and added.
+	GtkTreeModel *model = gtk_tree_view_get_model(GTK_TREE_VIEW(list));
+	g_object_ref(model);
+	gtk_tree_view_set_model(GTK_TREE_VIEW(list), NULL);
+	GtkListStore *store = GTK_LIST_STORE(model);
+	gtk_list_store_clear(store);
+	maxItemCharacters = 0;
 	int count = strlen(listText) + 1;
 	char *words = new char[count];
 	if (words) {
@@ -2783,7 +2866,7 @@ void ListBoxX::SetList(const char *listText, char separator, char typesep) {
 				words[i] = '\0';
 				if (numword)
 					*numword = '\0';
-				Append(startword, numword?atoi(numword + 1):-1);
+				AppendToStore(store, startword, numword?atoi(numword + 1):-1);
 				startword = words + i + 1;
 				numword = NULL;
 			} else if (words[i] == typesep) {
@@ -2793,10 +2876,12 @@ void ListBoxX::SetList(const char *listText, char separator, char typesep) {
 		if (startword) {
 			if (numword)
 				*numword = '\0';
-			Append(startword, numword?atoi(numword + 1):-1);
+			AppendToStore(store, startword, numword?atoi(numword + 1):-1);
 		}
 		delete []words;
 	}
+	gtk_tree_view_set_model(GTK_TREE_VIEW(list), model);
+	g_object_unref(model);
 }
 
 Menu::Menu() : mid(0) {}
@@ -2987,6 +3072,18 @@ int Platform::DBCSCharLength(int codePage, const char *s) {
 	}
 }
 
+void Platform::AtomicIncrement(int *value) {
+	g_atomic_int_inc(value);
+}
+
+bool Platform::AtomicDecrementAndTest(int *value) {
+	return g_atomic_int_dec_and_test(value) != 0;
+}
+
+int Platform::AtomicGet(int *value) {
+	return g_atomic_int_get(value);
+}
+
 int Platform::DBCSCharMaxLength() {
 	return MB_CUR_MAX;
 	//return 2;
@@ -3054,5 +3151,6 @@ void Platform_Initialise() {
 }
 
 void Platform_Finalise() {
+	FontCached::ReleaseUnused();
 	FontMutexFree();
 }
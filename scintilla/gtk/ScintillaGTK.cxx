@@ -1449,13 +1449,13 @@ void ScintillaGTK::CopyToClipboard(const SelectionText &selectedText) {
 void ScintillaGTK::Copy() {
 	if (!sel.Empty()) {
 #ifndef USE_GTK_CLIPBOARD
-		CopySelectionRange(&copyText);
+		DeferSelectionRange(&copyText);
 		gtk_selection_owner_set(GTK_WIDGET(PWidget(wMain)),
 		                        atomClipboard,
 		                        GDK_CURRENT_TIME);
 #else
 		SelectionText *clipText = new SelectionText();
-		CopySelectionRange(clipText);
+		DeferSelectionRange(clipText);
 		StoreOnClipboard(clipText);
 #endif
 #if PLAT_GTK_WIN32
@@ -1531,7 +1531,7 @@ void ScintillaGTK::ClaimSelection() {
 		primary.Free();
 	} else if (OwnPrimarySelection()) {
 		primarySelection = true;
-		if (primary.s == NULL)
+		if (!primary.HasText())
 			gtk_selection_owner_set(NULL, GDK_SELECTION_PRIMARY, GDK_CURRENT_TIME);
 	} else {
 		primarySelection = false;
@@ -1662,6 +1662,9 @@ void ScintillaGTK::ReceivedDrop(GtkSelectionData *selection_data) {
 
 
 void ScintillaGTK::GetSelection(GtkSelectionData *selection_data, guint info, SelectionText *text) {
+	// Large selections are only copied from the document when first requested
+	text->Retrieve();
+
 #if PLAT_GTK_WIN32
 	// GDK on Win32 expands any \n into \r\n, so make a copy of
 	// the clip text now with newlines converted to \n.  Use { } to hide symbols
@@ -1883,8 +1886,8 @@ gint ScintillaGTK::PressThis(GdkEventButton *event) {
 		} else if (event->button == 2) {
 			// Grab the primary selection if it exists
 			SelectionPosition pos = SPositionFromLocation(pt, false, false, UserVirtualSpace());
-			if (OwnPrimarySelection() && primary.s == NULL)
-				CopySelectionRange(&primary);
+			if (OwnPrimarySelection() && !primary.HasText())
+				DeferSelectionRange(&primary);
 
 			sel.Clear();
 			SetSelection(pos, pos);
@@ -2635,7 +2638,7 @@ void ScintillaGTK::SelectionGet(GtkWidget *widget,
 	try {
 		//Platform::DebugPrintf("Selection get\n");
 		if (SelectionOfGSD(selection_data) == GDK_SELECTION_PRIMARY) {
-			if (sciThis->primary.s == NULL) {
+			if (!sciThis->primary.HasText()) {
 				sciThis->CopySelectionRange(&sciThis->primary);
 			}
 			sciThis->GetSelection(selection_data, info, &sciThis->primary);
@@ -3045,3 +3048,8 @@ void scintilla_release_resources(void) {
 	} catch (...) {
 	}
 }
+
+// Length of the valid UTF-8 at the start of text and the number of characters in it
+unsigned int scintilla_utf8_validate(const char *text, unsigned int length, unsigned int *characters) {
+	return UTF8Validate(text, length, characters);
+}
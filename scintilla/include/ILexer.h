@@ -18,7 +18,7 @@ namespace Scintilla {
 	#define SCI_METHOD
 #endif
 
-enum { dvOriginal=0 };
+enum { dvOriginal=0, dvSegments=1 };
 
 class IDocument {
 public:
@@ -45,7 +45,21 @@ public:
 	virtual int SCI_METHOD GetLineIndentation(int line) = 0;
 };
 
-enum { lvOriginal=0 };
+/**
+ * A document that can expose its text in place as two contiguous segments, either
+ * of which may be empty. The pointers remain valid until the text is modified.
+ */
+class IDocumentWithSegments : public IDocument {
+public:
+	virtual void SCI_METHOD GetSegments(const char **segment1, int *length1, const char **segment2, int *length2) = 0;
+};
+
+/**
+ * Lexers reporting lvLineStates keep everything that affects the following lines in the
+ * style at the end of each line and in that line's state, so after an edit the document
+ * may stop lexing once both match their values from before the edit.
+ */
+enum { lvOriginal=0, lvLineStates=1 };
 
 class ILexer {
 public:
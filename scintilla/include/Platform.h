@@ -525,6 +525,10 @@ public:
 	static bool IsDBCSLeadByte(int codePage, char ch);
 	static int DBCSCharLength(int codePage, const char *s);
 	static int DBCSCharMaxLength();
+	// Reference counts that may be changed by more than one thread
+	static void AtomicIncrement(int *value);
+	static bool AtomicDecrementAndTest(int *value);	///< True when value reaches 0
+	static int AtomicGet(int *value);
 
 	// These are utility functions not really tied to a platform
 	static int Minimum(int a, int b);
@@ -819,6 +819,28 @@ typedef sptr_t (*SciFnDirect)(sptr_t ptr, unsigned int iMessage, uptr_t wParam,
 #define SCI_REGISTERRGBAIMAGE 2627
 #define SCI_SCROLLTOSTART 2628
 #define SCI_SCROLLTOEND 2629
+#define SCI_SETPAINTSTATISTICS 2630
+#define SCI_GETPAINTSTATISTICS 2631
+#define SC_PAINTSTAT_PAINTTIME 0
+#define SC_PAINTSTAT_STYLETIME 1
+#define SC_PAINTSTAT_WRAPTIME 2
+#define SC_PAINTSTAT_LAYOUTTIME 3
+#define SC_PAINTSTAT_MEASURETIME 4
+#define SC_PAINTSTAT_DRAWTIME 5
+#define SC_PAINTSTAT_BYTESSTYLED 6
+#define SC_PAINTSTAT_LINESWRAPPED 7
+#define SC_PAINTSTAT_LINESLAIDOUT 8
+#define SC_PAINTSTAT_LAYOUTCACHEHITS 9
+#define SC_PAINTSTAT_LINESDRAWN 10
+#define SCI_GETPAINTSTATISTIC 2632
+#define SC_IDLESTYLING_NONE 0
+#define SC_IDLESTYLING_AFTERVISIBLE 1
+#define SCI_SETIDLESTYLING 2635
+#define SCI_GETIDLESTYLING 2636
+#define SCI_SETCOALESCEMODEVENTS 2637
+#define SCI_GETCOALESCEMODEVENTS 2638
+#define SCI_CREATETEXTSNAPSHOT 2639
+#define SCI_RELEASETEXTSNAPSHOT 2640
 #define SCI_STARTRECORD 3001
 #define SCI_STOPRECORD 3002
 #define SCI_SETLEXER 4001
@@ -862,7 +884,9 @@ typedef sptr_t (*SciFnDirect)(sptr_t ptr, unsigned int iMessage, uptr_t wParam,
 #define SC_MOD_CHANGEANNOTATION 0x20000
 #define SC_MOD_CONTAINER 0x40000
 #define SC_MOD_LEXERSTATE 0x80000
-#define SC_MODEVENTMASKALL 0xFFFFF
+#define SC_MOD_COALESCED 0x100000
+#define SC_COALESCEDSTEP 0x200000
+#define SC_MODEVENTMASKALL 0x3FFFFF
 #define SC_UPDATE_CONTENT 0x1
 #define SC_UPDATE_SELECTION 0x2
 #define SC_UPDATE_V_SCROLL 0x4
@@ -923,6 +947,8 @@ typedef sptr_t (*SciFnDirect)(sptr_t ptr, unsigned int iMessage, uptr_t wParam,
 #define SCN_AUTOCCANCELLED 2025
 #define SCN_AUTOCCHARDELETED 2026
 #define SCN_HOTSPOTRELEASECLICK 2027
+#define SCN_STYLED 2028
+#define SCN_PAINTSTATISTICS 2029
 /* --Autogenerated -- end of section automatically generated from Scintilla.iface */
 
 /* These structures are defined to be exactly the same shape as the Win32
@@ -975,6 +1001,16 @@ struct Sci_RangeToFormat {
 
 #define RangeToFormat Sci_RangeToFormat
 
+/* Returned by SCI_CREATETEXTSNAPSHOT. The text is NUL terminated and does not change
+ * when the document is edited. Snapshots are created, and the document edited, on the
+ * thread that owns the Scintilla widget. Any thread, such as a worker handed the snapshot,
+ * can read the text until it releases the snapshot with SCI_RELEASETEXTSNAPSHOT sent to
+ * the widget, which must still exist. The reference count is updated atomically. */
+struct Sci_TextSnapshot {
+	const char *text;
+	int length;
+};
+
 struct Sci_NotifyHeader {
 	/* Compatible with Windows NMHDR.
 	 * hwndFrom is really an environment specific window handle or pointer
@@ -993,7 +1029,7 @@ struct SCNotification {
 	/* SCN_NEEDSHOWN, SCN_DWELLSTART, SCN_DWELLEND, SCN_CALLTIPCLICK, */
 	/* SCN_HOTSPOTCLICK, SCN_HOTSPOTDOUBLECLICK, SCN_HOTSPOTRELEASECLICK, */
 	/* SCN_INDICATORCLICK, SCN_INDICATORRELEASE, */
-	/* SCN_USERLISTSELECTION, SCN_AUTOCSELECTION */
+	/* SCN_USERLISTSELECTION, SCN_AUTOCSELECTION, SCN_STYLED */
 
 	int ch;		/* SCN_CHARADDED, SCN_KEY */
 	int modifiers;
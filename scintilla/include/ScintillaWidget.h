@@ -39,6 +39,7 @@ GtkWidget*	scintilla_new		(void);
 void		scintilla_set_id	(ScintillaObject *sci, uptr_t id);
 sptr_t		scintilla_send_message	(ScintillaObject *sci,unsigned int iMessage, uptr_t wParam, sptr_t lParam);
 void		scintilla_release_resources(void);
+unsigned int	scintilla_utf8_validate(const char *text, unsigned int length, unsigned int *characters);
 
 #define SCINTILLA_NOTIFY "sci-notify"
 
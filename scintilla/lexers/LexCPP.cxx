@@ -33,7 +33,6 @@
 #include "CharacterSet.h"
 #include "LexerModule.h"
 #include "OptionSet.h"
-#include "SparseState.h"
 
 #ifdef SCI_NAMESPACE
 using namespace Scintilla;
@@ -127,15 +126,6 @@ static std::vector<std::string> Tokenize(const std::string &s) {
 	return tokens;
 }
 
-struct PPDefinition {
-	int line;
-	std::string key;
-	std::string value;
-	PPDefinition(int line_, const std::string &key_, const std::string &value_) :
-		line(line_), key(key_), value(value_) {
-	}
-};
-
 class LinePPState {
 	int state;
 	int ifTaken;
@@ -180,23 +170,218 @@ public:
 			ifTaken |= maskLevel();
 		}
 	}
+	bool operator<(const LinePPState &other) const {
+		if (state != other.state)
+			return state < other.state;
+		if (ifTaken != other.ifTaken)
+			return ifTaken < other.ifTaken;
+		return level < other.level;
+	}
+};
+
+// A #define seen while lexing along with the definition made before it.
+struct PPDefinition {
+	int previous;
+	std::string key;
+	std::string value;
+	PPDefinition(int previous_, const std::string &key_, const std::string &value_) :
+		previous(previous_), key(key_), value(value_) {
+	}
+	bool operator<(const PPDefinition &other) const {
+		if (previous != other.previous)
+			return previous < other.previous;
+		if (key != other.key)
+			return key < other.key;
+		return value < other.value;
+	}
 };
 
-// Hold the preprocessor state for each line seen.
-// Currently one entry per line but could become sparse with just one entry per preprocessor line.
+// Hold the state at the start of each line seen: the #if nesting, the last #define
+// before the line, the terminator of any raw string continuing onto the line and the
+// last visible character before the line which decides whether '/' starts a regex.
+// Equal states are shared and identified by a number which is stored as the line
+// state of the previous line so it moves with the line when text is inserted or
+// deleted. Lexing can then restart at any line and, unless an edit changes a
+// preprocessor line or a raw string, later lines keep their numbers so the document
+// can stop lexing as soon as they match.
+// Each definition links to the one before it and the definitions at a line are only
+// rebuilt from those links when lexing does not continue from where it last stopped.
+// Edits replace line states so, once enough have been added, states and definitions
+// no longer reachable from any line are freed and their numbers reused.
 class PPStates {
-	std::vector<LinePPState> vlls;
+	typedef std::map<std::string, std::string> Definitions;
 public:
-	LinePPState ForLine(int line) {
-		if ((line > 0) && (vlls.size() > static_cast<size_t>(line))) {
-			return vlls[line];
+	struct State {
+		LinePPState lls;
+		int definition;
+		std::string rawStringTerminator;
+		int chPrevNonWhite;
+		State(LinePPState lls_, int definition_, const std::string &rawStringTerminator_, int chPrevNonWhite_) :
+			lls(lls_), definition(definition_), rawStringTerminator(rawStringTerminator_),
+			chPrevNonWhite(chPrevNonWhite_) {
+		}
+		bool operator<(const State &other) const {
+			if (definition != other.definition)
+				return definition < other.definition;
+			if (chPrevNonWhite != other.chPrevNonWhite)
+				return chPrevNonWhite < other.chPrevNonWhite;
+			if (rawStringTerminator != other.rawStringTerminator)
+				return rawStringTerminator < other.rawStringTerminator;
+			return lls < other.lls;
+		}
+	};
+private:
+	Definitions definitionsStart;
+	std::vector<PPDefinition> definitions;
+	std::map<PPDefinition, int> definitionIndex;
+	std::vector<int> definitionsFree;
+	std::vector<State> states;
+	std::map<State, int> stateIndex;
+	std::vector<int> statesFree;
+	Definitions definitionsKept;
+	int definitionKept;	// The definition definitionsKept was built for or noDefinition
+	int first;	// Number of states[0], never reused after Reset so old line states do not match
+	int added;	// States and definitions added since the last collection
+	int addedLimit;
+	enum { minimumAddedLimit = 0x4000 };
+	enum { noDefinition = -2 };
+	static int AddTo(std::vector<int> &freeList, int size) {
+		if (freeList.empty())
+			return size;
+		const int index = freeList.back();
+		freeList.pop_back();
+		return index;
+	}
+public:
+	PPStates() : definitionKept(noDefinition), first(0), added(0), addedLimit(minimumAddedLimit) {
+		Reset();
+	}
+	void Reset() {
+		definitionsKept.clear();
+		definitionKept = noDefinition;
+		definitions.clear();
+		definitionIndex.clear();
+		definitionsFree.clear();
+		first += static_cast<int>(states.size());
+		states.clear();
+		stateIndex.clear();
+		statesFree.clear();
+		Add(LinePPState(), -1, std::string(), ' ');
+		added = 0;
+	}
+	void SetDefinitionsStart(const Definitions &definitionsStart_) {
+		definitionsStart = definitionsStart_;
+		Reset();
+	}
+	bool NeedsCollection() const {
+		return added > addedLimit;
+	}
+	// Free the states not held by any line of the document and the definitions they do
+	// not use. The initial state is always kept.
+	void Collect(LexAccessor &styler) {
+		definitionsKept.clear();
+		definitionKept = noDefinition;
+		std::vector<bool> stateLive(states.size(), false);
+		stateLive[0] = true;
+		const int lines = styler.GetLine(styler.Length()) + 1;
+		for (int line = 0; line < lines; line++) {
+			const int index = styler.GetLineState(line) - first;
+			if ((index >= 0) && (index < static_cast<int>(states.size())))
+				stateLive[index] = true;
+		}
+		std::vector<bool> definitionLive(definitions.size(), false);
+		int live = 0;
+		for (size_t index = 0; index < states.size(); index++) {
+			if (stateLive[index]) {
+				live++;
+				for (int definition = states[index].definition;
+					(definition >= 0) && !definitionLive[definition];
+					definition = definitions[definition].previous) {
+					definitionLive[definition] = true;
+					live++;
+				}
+			} else {
+				// Entries already freed read as the initial state which is indexed elsewhere
+				std::map<State, int>::iterator it = stateIndex.find(states[index]);
+				if ((it != stateIndex.end()) && (it->second == first + static_cast<int>(index))) {
+					stateIndex.erase(it);
+					states[index] = State(LinePPState(), -1, std::string(), ' ');
+					statesFree.push_back(static_cast<int>(index));
+				}
+			}
+		}
+		for (size_t definition = 0; definition < definitions.size(); definition++) {
+			if (!definitionLive[definition]) {
+				std::map<PPDefinition, int>::iterator it = definitionIndex.find(definitions[definition]);
+				if ((it != definitionIndex.end()) && (it->second == static_cast<int>(definition))) {
+					definitionIndex.erase(it);
+					definitions[definition] = PPDefinition(-1, std::string(), std::string());
+					definitionsFree.push_back(static_cast<int>(definition));
+				}
+			}
+		}
+		added = 0;
+		addedLimit = std::max(static_cast<int>(minimumAddedLimit), live);
+	}
+	int Initial() const {
+		return first;
+	}
+	const State &ForState(int number) const {
+		const int index = number - first;
+		if ((index < 0) || (index >= static_cast<int>(states.size())))
+			return states[0];
+		return states[index];
+	}
+	Definitions DefinitionsAt(int definition) const {
+		// Going back from the last definition, the first value seen for a key is in force
+		Definitions ret;
+		for (; definition >= 0; definition = definitions[definition].previous) {
+			ret.insert(std::make_pair(definitions[definition].key, definitions[definition].value));
+		}
+		ret.insert(definitionsStart.begin(), definitionsStart.end());
+		return ret;
+	}
+	// Lexing usually continues from where it last stopped so keep the definitions from
+	// there instead of building them again.
+	void KeepDefinitions(int definition, Definitions &definitionsEnd) {
+		definitionKept = definition;
+		definitionsKept.swap(definitionsEnd);
+	}
+	void TakeDefinitions(int definition, Definitions &definitionsAt) {
+		if (definition == definitionKept) {
+			definitionsAt.swap(definitionsKept);
+			definitionKept = noDefinition;
 		} else {
-			return LinePPState();
+			definitionsAt = DefinitionsAt(definition);
 		}
 	}
-	void Add(int line, LinePPState lls) {
-		vlls.resize(line+1);
-		vlls[line] = lls;
+	int AddDefinition(int previous, const std::string &key, const std::string &value) {
+		PPDefinition def(previous, key, value);
+		std::map<PPDefinition, int>::const_iterator it = definitionIndex.find(def);
+		if (it != definitionIndex.end())
+			return it->second;
+		const int definition = AddTo(definitionsFree, static_cast<int>(definitions.size()));
+		if (definition == static_cast<int>(definitions.size()))
+			definitions.push_back(def);
+		else
+			definitions[definition] = def;
+		definitionIndex[def] = definition;
+		added++;
+		return definition;
+	}
+	int Add(LinePPState lls, int definition, const std::string &rawStringTerminator, int chPrevNonWhite) {
+		State state(lls, definition, rawStringTerminator, chPrevNonWhite);
+		std::map<State, int>::const_iterator it = stateIndex.find(state);
+		if (it != stateIndex.end())
+			return it->second;
+		const int index = AddTo(statesFree, static_cast<int>(states.size()));
+		if (index == static_cast<int>(states.size()))
+			states.push_back(state);
+		else
+			states[index] = state;
+		stateIndex[state] = first + index;
+		added++;
+		return first + index;
 	}
 };
 
@@ -313,17 +498,14 @@ class LexerCPP : public ILexer {
 	CharacterSet setArithmethicOp;
 	CharacterSet setRelOp;
 	CharacterSet setLogicalOp;
-	PPStates vlls;
-	std::vector<PPDefinition> ppDefineHistory;
+	PPStates ppStates;
 	WordList keywords;
 	WordList keywords2;
 	WordList keywords3;
 	WordList keywords4;
 	WordList ppDefinitions;
-	std::map<std::string, std::string> preprocessorDefinitionsStart;
 	OptionsCPP options;
 	OptionSetCPP osCPP;
-	SparseState<std::string> rawStringTerminators;
 	enum { activeFlag = 0x40 };
 public:
 	LexerCPP(bool caseSensitive_) :
@@ -340,7 +522,7 @@ public:
 		delete this;
 	}
 	int SCI_METHOD Version() const {
-		return lvOriginal;
+		return lvLineStates;
 	}
 	const char * SCI_METHOD PropertyNames() {
 		return osCPP.PropertyNames();
@@ -404,14 +586,11 @@ int SCI_METHOD LexerCPP::WordListSet(int n, const char *wl) {
 	}
 	int firstModification = -1;
 	if (wordListN) {
-		WordList wlNew;
-		wlNew.Set(wl);
-		if (*wordListN != wlNew) {
-			wordListN->Set(wl);
+		if (wordListN->Update(wl)) {
 			firstModification = 0;
 			if (n == 4) {
 				// Rebuild preprocessorDefinitions
-				preprocessorDefinitionsStart.clear();
+				std::map<std::string, std::string> preprocessorDefinitionsStart;
 				for (int nDefinition = 0; nDefinition < ppDefinitions.len; nDefinition++) {
 					char *cpDefinition = ppDefinitions.words[nDefinition];
 					char *cpEquals = strchr(cpDefinition, '=');
@@ -425,21 +604,13 @@ int SCI_METHOD LexerCPP::WordListSet(int n, const char *wl) {
 						preprocessorDefinitionsStart[name] = val;
 					}
 				}
+				ppStates.SetDefinitionsStart(preprocessorDefinitionsStart);
 			}
 		}
 	}
 	return firstModification;
 }
 
-// Functor used to truncate history
-struct After {
-	int line;
-	After(int line_) : line(line_) {}
-	bool operator()(PPDefinition &p) const {
-		return p.line > line;
-	}
-};
-
 void SCI_METHOD LexerCPP::Lex(unsigned int startPos, int length, int initStyle, IDocument *pAccess) {
 	LexAccessor styler(pAccess);
 
@@ -455,7 +626,6 @@ void SCI_METHOD LexerCPP::Lex(unsigned int startPos, int length, int initStyle,
 		setWord.Add('$');
 	}
 
-	int chPrevNonWhite = ' ';
 	int visibleChars = 0;
 	bool lastWordWasUUID = false;
 	int styleBeforeDCKeyword = SCE_C_DEFAULT;
@@ -480,39 +650,20 @@ void SCI_METHOD LexerCPP::Lex(unsigned int startPos, int length, int initStyle,
 		}
 	}
 
-	// look back to set chPrevNonWhite properly for better regex colouring
-	if (startPos > 0) {
-		int back = startPos;
-		while (--back && IsSpaceEquiv(styler.StyleAt(back)))
-			;
-		if (styler.StyleAt(back) == SCE_C_OPERATOR) {
-			chPrevNonWhite = styler.SafeGetCharAt(back);
-		}
-	}
-
 	StyleContext sc(startPos, length, initStyle, styler, 0x7f);
-	LinePPState preproc = vlls.ForLine(lineCurrent);
-
-	bool definitionsChanged = false;
-
-	// Truncate ppDefineHistory before current line
 
-	if (!options.updatePreprocessor)
-		ppDefineHistory.clear();
-
-	std::vector<PPDefinition>::iterator itInvalid = std::find_if(ppDefineHistory.begin(), ppDefineHistory.end(), After(lineCurrent-1));
-	if (itInvalid != ppDefineHistory.end()) {
-		ppDefineHistory.erase(itInvalid, ppDefineHistory.end());
-		definitionsChanged = true;
-	}
-
-	std::map<std::string, std::string> preprocessorDefinitions = preprocessorDefinitionsStart;
-	for (std::vector<PPDefinition>::iterator itDef = ppDefineHistory.begin(); itDef != ppDefineHistory.end(); ++itDef) {
-		preprocessorDefinitions[itDef->key] = itDef->value;
-	}
-
-	std::string rawStringTerminator = rawStringTerminators.ValueAt(lineCurrent-1);
-	SparseState<std::string> rawSTNew(lineCurrent);
+	// Edits leave states behind that no line uses any more
+	if (ppStates.NeedsCollection())
+		ppStates.Collect(styler);
+	// Copied as adding states may move them
+	const PPStates::State &stateStart = ppStates.ForState(
+		(lineCurrent > 0) ? styler.GetLineState(lineCurrent-1) : ppStates.Initial());
+	LinePPState preproc = stateStart.lls;
+	int definition = options.updatePreprocessor ? stateStart.definition : -1;
+	std::string rawStringTerminator = stateStart.rawStringTerminator;
+	int chPrevNonWhite = stateStart.chPrevNonWhite;
+	std::map<std::string, std::string> preprocessorDefinitions;
+	ppStates.TakeDefinitions(definition, preprocessorDefinitions);
 
 	int activitySet = preproc.IsInactive() ? activeFlag : 0;
 
@@ -543,16 +694,15 @@ void SCI_METHOD LexerCPP::Lex(unsigned int startPos, int length, int initStyle,
 		}
 
 		if (sc.atLineEnd) {
+			styler.SetLineState(lineCurrent, ppStates.Add(preproc, definition, rawStringTerminator, chPrevNonWhite));
 			lineCurrent++;
-			vlls.Add(lineCurrent, preproc);
-			if (rawStringTerminator != "") {
-				rawSTNew.Set(lineCurrent-1, rawStringTerminator);
-			}
 		}
 
 		// Handle line continuation generically.
 		if (sc.ch == '\\') {
 			if (sc.chNext == '\n' || sc.chNext == '\r') {
+				styler.SetLineState(lineCurrent, ppStates.Add(preproc, definition, rawStringTerminator, chPrevNonWhite));
+				lineCurrent++;
 				sc.Forward();
 				if (sc.ch == '\r' && sc.chNext == '\n') {
 					sc.Forward();
@@ -756,8 +906,8 @@ void SCI_METHOD LexerCPP::Lex(unsigned int startPos, int length, int initStyle,
 
 		if (sc.atLineEnd && !atLineEndBeforeSwitch) {
 			// State exit processing consumed characters up to end of line.
+			styler.SetLineState(lineCurrent, ppStates.Add(preproc, definition, rawStringTerminator, chPrevNonWhite));
 			lineCurrent++;
-			vlls.Add(lineCurrent, preproc);
 		}
 
 		// Determine if a new state should be entered.
@@ -808,8 +958,9 @@ void SCI_METHOD LexerCPP::Lex(unsigned int startPos, int length, int initStyle,
 						sc.SetState(SCE_C_STRINGRAW|activitySet);
 						rawStringTerminator = ")";
 						for (int termPos = sc.currentPos + 1;; termPos++) {
+							// Delimiters do not span lines so later lines can not change this one
 							char chTerminator = styler.SafeGetCharAt(termPos, '(');
-							if (chTerminator == '(')
+							if ((chTerminator == '(') || (chTerminator == '\r') || (chTerminator == '\n'))
 								break;
 							rawStringTerminator += chTerminator;
 						}
@@ -833,6 +984,9 @@ void SCI_METHOD LexerCPP::Lex(unsigned int startPos, int length, int initStyle,
 					sc.Forward();
 				} while ((sc.ch == ' ' || sc.ch == '\t') && sc.More());
 				if (sc.atLineEnd) {
+					// Skipping reached the line end so record the state for the line here
+					styler.SetLineState(lineCurrent, ppStates.Add(preproc, definition, rawStringTerminator, chPrevNonWhite));
+					lineCurrent++;
 					sc.SetState(SCE_C_DEFAULT|activitySet);
 				} else if (sc.Match("include")) {
 					isIncludePreprocessor = true;
@@ -895,8 +1049,7 @@ void SCI_METHOD LexerCPP::Lex(unsigned int startPos, int length, int initStyle,
 											value = tokens[1];
 										}
 										preprocessorDefinitions[key] = value;
-										ppDefineHistory.push_back(PPDefinition(lineCurrent, key, value));
-										definitionsChanged = true;
+										definition = ppStates.AddDefinition(definition, key, value);
 									}
 								}
 							}
@@ -914,9 +1067,7 @@ void SCI_METHOD LexerCPP::Lex(unsigned int startPos, int length, int initStyle,
 		}
 		continuationLine = false;
 	}
-	const bool rawStringsChanged = rawStringTerminators.Merge(rawSTNew, lineCurrent);
-	if (definitionsChanged || rawStringsChanged)
-		styler.ChangeLexerState(startPos, startPos + length);
+	ppStates.KeepDefinitions(definition, preprocessorDefinitions);
 	sc.Complete();
 }
 
@@ -235,10 +235,7 @@ int SCI_METHOD LexerD::WordListSet(int n, const char *wl) {
 	}
 	int firstModification = -1;
 	if (wordListN) {
-		WordList wlNew;
-		wlNew.Set(wl);
-		if (*wordListN != wlNew) {
-			wordListN->Set(wl);
+		if (wordListN->Update(wl)) {
 			firstModification = 0;
 		}
 	}
@@ -507,6 +507,33 @@ static bool isMakoBlockEnd(const int ch, const int chNext, const char *blockType
 	}
 }
 
+// Mako and Django blocks end in the same way for all block types in one of these
+// groups so only the group is kept in the line state.
+static const char * const makoBlockGroups[] = {"", "%", "{", "include", "def"};
+static const char * const djangoBlockGroups[] = {"", "%", "{"};
+
+static int MakoBlockGroup(const char *blockType) {
+	if (strlen(blockType) == 0)
+		return 0;
+	else if (0 == strcmp(blockType, "%"))
+		return 1;
+	else if (0 == strcmp(blockType, "{"))
+		return 2;
+	else if (isMakoBlockEnd('/', '>', blockType))
+		return 3;
+	else
+		return 4;
+}
+
+static int DjangoBlockGroup(const char *blockType) {
+	if (0 == strcmp(blockType, "%"))
+		return 1;
+	else if (0 == strcmp(blockType, "{"))
+		return 2;
+	else
+		return 0;
+}
+
 static bool isDjangoBlockEnd(const int ch, const int chNext, const char *blockType) {
 	if (strlen(blockType) == 0) {
 		return 0;
@@ -574,6 +601,25 @@ static int FindPhpStringDelimiter(char *phpStringDelimiter, const int phpStringD
 	return j - 1;
 }
 
+enum { heredocLineState = 1 << 25 };
+
+// A heredoc or nowdoc continues onto line so find its delimiter on the line where it
+// started, found through the line states, instead of lexing the whole string again.
+static void FindHeredocDelimiter(char *phpStringDelimiter, const int phpStringDelimiterSize, int line, Accessor &styler) {
+	int lineStart = line - 1;
+	while ((lineStart > 0) && (styler.GetLineState(lineStart - 1) & heredocLineState))
+		lineStart--;
+	const int startPos = styler.LineStart(lineStart);
+	const int endPos = styler.LineStart(lineStart + 1);
+	phpStringDelimiter[0] = '\0';
+	for (int i = startPos; i < endPos; i++) {
+		if (styler.Match(i, "<<<") && isPHPStringState(styler.StyleAt(i))) {
+			bool isSimpleString = false;
+			i = FindPhpStringDelimiter(phpStringDelimiter, phpStringDelimiterSize, i + 3, endPos, styler, isSimpleString);
+		}
+	}
+}
+
 static void ColouriseHyperTextDoc(unsigned int startPos, int length, int initStyle, WordList *keywordlists[],
                                   Accessor &styler, bool isXml) {
 	WordList &keywords = *keywordlists[0];
@@ -605,13 +651,13 @@ static void ColouriseHyperTextDoc(unsigned int startPos, int length, int initSty
 		}
 		state = SCE_H_DEFAULT;
 	}
-	// String can be heredoc, must find a delimiter first. Reread from beginning of line containing the string, to get the correct lineState
+	// String can be heredoc, must find a delimiter first. Restart from the beginning of the line containing the position
+	// as the line state of the previous line shows how to find the delimiter
 	if (isPHPStringState(state)) {
-		while (startPos > 0 && (isPHPStringState(state) || !isLineEnd(styler[startPos - 1]))) {
-			startPos--;
-			length++;
-			state = styler.StyleAt(startPos);
-		}
+		const int lineStartPos = styler.LineStart(styler.GetLine(startPos));
+		length += startPos - lineStartPos;
+		startPos = lineStartPos;
+		state = stateForPrintState(styler.StyleAt(startPos - 1));
 		if (startPos == 0)
 			state = SCE_H_DEFAULT;
 	}
@@ -637,12 +683,32 @@ static void ColouriseHyperTextDoc(unsigned int startPos, int length, int initSty
 	script_type aspScript = script_type((lineState >> 4) & 0x0F); // 4 bits of script name
 	script_type clientScript = script_type((lineState >> 8) & 0x0F); // 4 bits of script name
 	int beforePreProc = (lineState >> 12) & 0xFF; // 8 bits of state
+	const int makoGroup = (lineState >> 20) & 0x07; // 3 bits of Mako block group
+	strcpy(makoBlockType, makoBlockGroups[(makoGroup <= 4) ? makoGroup : 0]);
+	const int djangoGroup = (lineState >> 23) & 0x03; // 2 bits of Django block group
+	strcpy(djangoBlockType, djangoBlockGroups[(djangoGroup <= 2) ? djangoGroup : 0]);
+
+	// Continuing a string so restore its delimiter from the line state
+	if (isPHPStringState(state)) {
+		if (lineState & heredocLineState)
+			FindHeredocDelimiter(phpStringDelimiter, sizeof(phpStringDelimiter), lineCurrent, styler);
+		else if (state == SCE_HPHP_SIMPLESTRING)
+			strcpy(phpStringDelimiter, "\'");
+		else
+			strcpy(phpStringDelimiter, "\"");
+	}
 
 	script_type scriptLanguage = ScriptOfState(state);
 	// If eNonHtmlScript coincides with SCE_H_COMMENT, assume eScriptComment
 	if (inScriptType == eNonHtmlScript && state == SCE_H_COMMENT) {
 		scriptLanguage = eScriptComment;
 	}
+	// Restarting at the start of a line so continue in the language the previous line ended in
+	const int lineLanguage = (lineState >> 26) & 0x0F; // 4 bits of script language
+	if ((lineCurrent > 0) && (styler.LineStart(lineCurrent) == static_cast<int>(startPos)) &&
+		(lineLanguage <= eScriptComment)) {
+		scriptLanguage = script_type(lineLanguage);
+	}
 	script_type beforeLanguage = ScriptOfState(beforePreProc);
 
 	// property fold.html
@@ -697,6 +763,9 @@ static void ColouriseHyperTextDoc(unsigned int startPos, int length, int initSty
 
 	int chPrev = ' ';
 	int ch = ' ';
+	// A heredoc may end at the start of the first line so the line end before it is needed
+	if (isPHPStringState(state) && (startPos > 0))
+		ch = static_cast<unsigned char>(styler.SafeGetCharAt(startPos - 1));
 	int chPrevNonWhite = ' ';
 	// look back to set chPrevNonWhite properly for better regex colouring
 	if (scriptLanguage == eScriptJS && startPos > 0) {
@@ -813,13 +882,28 @@ static void ColouriseHyperTextDoc(unsigned int startPos, int length, int initSty
 				visibleChars = 0;
 				levelPrev = levelCurrent;
 			}
+			const bool inHeredoc = isPHPStringState(state) &&
+				(phpStringDelimiter[0] != '\"') && (phpStringDelimiter[0] != '\'');
+			// A Mako line block is ended by this line end so record the state after it
+			script_mode lineScriptType = inScriptType;
+			script_type lineLanguage = scriptLanguage;
+			if (isMako && (0 == strcmp(makoBlockType, "%")) &&
+				((inScriptType == eNonHtmlPreProc) || (inScriptType == eNonHtmlScriptPreProc)) &&
+				(scriptLanguage != eScriptNone) && stateAllowsTermination(state)) {
+				lineScriptType = (inScriptType == eNonHtmlScriptPreProc) ? eNonHtmlScript : eHtml;
+				lineLanguage = eScriptNone;
+			}
 			styler.SetLineState(lineCurrent,
-			                    ((inScriptType & 0x03) << 0) |
+			                    ((lineScriptType & 0x03) << 0) |
 			                    ((tagOpened & 0x01) << 2) |
 			                    ((tagClosing & 0x01) << 3) |
 			                    ((aspScript & 0x0F) << 4) |
 			                    ((clientScript & 0x0F) << 8) |
-			                    ((beforePreProc & 0xFF) << 12));
+			                    ((beforePreProc & 0xFF) << 12) |
+			                    ((MakoBlockGroup(makoBlockType) & 0x07) << 20) |
+			                    ((DjangoBlockGroup(djangoBlockType) & 0x03) << 23) |
+			                    (inHeredoc ? heredocLineState : 0) |
+			                    ((lineLanguage & 0x0F) << 26));
 			lineCurrent++;
 			lineStartVisibleChars = 0;
 		}
@@ -832,8 +916,9 @@ static void ColouriseHyperTextDoc(unsigned int startPos, int length, int initSty
 		// handle end of Mako comment line
 		else if (isMako && makoComment && (ch == '\r' || ch == '\n')) {
 			makoComment = 0;
-			styler.ColourTo(i, SCE_HP_COMMENTLINE);
-			state = SCE_HP_DEFAULT;
+			// The line end takes the following state so lexing can restart on the next line
+			styler.ColourTo(i - 1, SCE_HP_COMMENTLINE);
+			state = (scriptLanguage == eScriptPython) ? SCE_HP_DEFAULT : SCE_H_DEFAULT;
 		}
 		
 		// Allow falling through to mako handling code if newline is going to end a block
@@ -421,10 +421,7 @@ int SCI_METHOD LexerPerl::WordListSet(int n, const char *wl) {
 	}
 	int firstModification = -1;
 	if (wordListN) {
-		WordList wlNew;
-		wlNew.Set(wl);
-		if (*wordListN != wlNew) {
-			wordListN->Set(wl);
+		if (wordListN->Update(wl)) {
 			firstModification = 0;
 		}
 	}
@@ -22,9 +22,17 @@ private:
 	 * in case there is some backtracking. */
 	enum {bufferSize=4000, slopSize=bufferSize/8};
 	char buf[bufferSize+1];
+	/** When the document exposes its text in place, @a window is one of its two
+	 * segments and @a buf is unused. Otherwise text is copied into @a buf. */
+	const char *segment1;
+	const char *segment2;
+	int lengthSegment1;
+	bool direct;
+	const char *window;
 	int startPos;
 	int endPos;
 	int codePage;
+	bool dbcs;
 	int lenDoc;
 	int mask;
 	char styleBuf[bufferSize];
@@ -35,6 +43,18 @@ private:
 	int startPosStyling;
 
 	void Fill(int position) {
+		if (direct) {
+			if (position < lengthSegment1) {
+				window = segment1;
+				startPos = 0;
+				endPos = lengthSegment1;
+			} else {
+				window = segment2;
+				startPos = lengthSegment1;
+				endPos = lenDoc;
+			}
+			return;
+		}
 		startPos = position - slopSize;
 		if (startPos + bufferSize > lenDoc)
 			startPos = lenDoc - bufferSize;
@@ -46,20 +66,35 @@ private:
 
 		pAccess->GetCharRange(buf, startPos, endPos-startPos);
 		buf[endPos-startPos] = '\0';
+		window = buf;
 	}
 
 public:
 	LexAccessor(IDocument *pAccess_) :
-		pAccess(pAccess_), startPos(extremePosition), endPos(0),
-		codePage(pAccess->CodePage()), lenDoc(pAccess->Length()),
+		pAccess(pAccess_), segment1(0), segment2(0), lengthSegment1(0), direct(false),
+		window(buf), startPos(extremePosition), endPos(0),
+		codePage(pAccess->CodePage()), dbcs(false), lenDoc(pAccess->Length()),
 		mask(127), validLen(0), chFlags(0), chWhile(0),
 		startSeg(0), startPosStyling(0) {
+		// Only double byte code pages have lead bytes and 65001 is UTF-8
+		dbcs = (codePage != 0) && (codePage != 65001);
+		if (pAccess->Version() >= dvSegments) {
+			// The text can not change while lexing so read it in place
+			int lengthSegment2 = 0;
+			static_cast<IDocumentWithSegments *>(pAccess)->GetSegments(
+				&segment1, &lengthSegment1, &segment2, &lengthSegment2);
+			direct = true;
+		}
 	}
 	char operator[](int position) {
 		if (position < startPos || position >= endPos) {
 			Fill(position);
+			if (position < startPos || position >= endPos) {
+				// Past either end of the document
+				return '\0';
+			}
 		}
-		return buf[position - startPos];
+		return window[position - startPos];
 	}
 	/** Safe version of operator[], returning a defined value for invalid position. */
 	char SafeGetCharAt(int position, char chDefault=' ') {
@@ -70,10 +105,11 @@ public:
 				return chDefault;
 			}
 		}
-		return buf[position - startPos];
+		return window[position - startPos];
 	}
 	bool IsLeadByte(char ch) {
-		return pAccess->IsDBCSLeadByte(ch);
+		// Lead bytes are never ASCII so runs of ASCII text avoid asking the document
+		return dbcs && (static_cast<unsigned char>(ch) >= 0x80) && pAccess->IsDBCSLeadByte(ch);
 	}
 
 	bool Match(int pos, const char *s) {
@@ -77,10 +77,7 @@ const char * SCI_METHOD LexerBase::DescribeWordListSets() {
 
 int SCI_METHOD LexerBase::WordListSet(int n, const char *wl) {
 	if (n < numWordLists) {
-		WordList wlNew;
-		wlNew.Set(wl);
-		if (*keyWordLists[n] != wlNew) {
-			keyWordLists[n]->Set(wl);
+		if (keyWordLists[n]->Update(wl)) {
 			return 0;
 		}
 	}
@@ -11,8 +11,6 @@
 #include <stdio.h>
 #include <stdarg.h>
 
-#include <algorithm>
-
 #include "WordList.h"
 
 #ifdef SCI_NAMESPACE
@@ -68,11 +66,26 @@ static char **ArrayFromWordList(char *wordlist, int *len, bool onlyLineEnds = fa
 	return keywords;
 }
 
+// Terminates the list of words when there is no list buffer
+static char emptyWord[] = "";
+
+static unsigned int HashWord(const char *s) {
+	// FNV-1a
+	unsigned int hash = 2166136261u;
+	for (; *s; s++) {
+		hash ^= static_cast<unsigned char>(*s);
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
 bool WordList::operator!=(const WordList &other) const {
+	// Neither list contains duplicates so the same length and every word
+	// found in the other means the same words.
 	if (len != other.len)
 		return true;
 	for (int i=0; i<len; i++) {
-		if (strcmp(words[i], other.words[i]) != 0)
+		if (other.FindSlot(words[i]) < 0)
 			return true;
 	}
 	return false;
@@ -80,48 +93,177 @@ bool WordList::operator!=(const WordList &other) const {
 
 void WordList::Clear() {
 	if (words) {
+		for (int i=0; i<len; i++) {
+			if (Owned(words[i]))
+				delete []words[i];
+		}
 		delete []list;
 		delete []words;
 	}
+	delete []table;
 	words = 0;
 	list = 0;
+	listLength = 0;
 	len = 0;
+	capacity = 0;
+	prefixes = 0;
+	table = 0;
+	tableSize = 0;
+	tableUsed = 0;
 }
 
-#ifdef _MSC_VER
-
-static bool cmpWords(const char *a, const char *b) {
-	return strcmp(a, b) == -1;
+// Words added individually are allocated separately from the list buffer.
+bool WordList::Owned(const char *word) const {
+	return (word != emptyWord) && ((word < list) || (word > list + listLength));
 }
 
-#else
+// Returns the slot of the table holding the index of word or -1 when not present.
+int WordList::FindSlot(const char *word) const {
+	if (!table)
+		return -1;
+	const int mask = tableSize - 1;
+	for (int slot = HashWord(word) & mask; table[slot] != -1; slot = (slot + 1) & mask) {
+		if ((table[slot] >= 0) && (strcmp(words[table[slot]], word) == 0))
+			return slot;
+	}
+	return -1;
+}
 
-static int cmpWords(const void *a, const void *b) {
-	return strcmp(*static_cast<const char * const *>(a), *static_cast<const char * const *>(b));
+void WordList::Insert(int index) {
+	const int mask = tableSize - 1;
+	int slot = HashWord(words[index]) & mask;
+	while (table[slot] >= 0) {
+		slot = (slot + 1) & mask;
+	}
+	if (table[slot] == -1)
+		tableUsed++;
+	table[slot] = index;
 }
 
-static void SortWordList(char **words, unsigned int len) {
-	qsort(reinterpret_cast<void *>(words), len, sizeof(*words), cmpWords);
+// Rebuild the table to hold at least size words without any removed slots.
+void WordList::Rehash(int size) {
+	delete []table;
+	tableSize = 16;
+	while (tableSize < size * 2)
+		tableSize *= 2;
+	table = new int[tableSize];
+	for (int slot = 0; slot < tableSize; slot++)
+		table[slot] = -1;
+	tableUsed = 0;
+	for (int i = 0; i < len; i++)
+		Insert(i);
 }
 
-#endif
+void WordList::MoveWord(int from, int to) {
+	table[FindSlot(words[from])] = to;
+	words[to] = words[from];
+}
 
 void WordList::Set(const char *s) {
 	Clear();
-	list = new char[strlen(s) + 1];
+	listLength = static_cast<int>(strlen(s));
+	list = new char[listLength + 1];
 	strcpy(list, s);
-	words = ArrayFromWordList(list, &len, onlyLineEnds);
-#ifdef _MSC_VER
-	std::sort(words, words + len, cmpWords);
-#else
-	SortWordList(words, len);
-#endif
-	for (unsigned int k = 0; k < (sizeof(starts) / sizeof(starts[0])); k++)
-		starts[k] = -1;
-	for (int l = len - 1; l >= 0; l--) {
-		unsigned char indexChar = words[l][0];
-		starts[indexChar] = l;
+	int lenList = 0;
+	char **wordsList = ArrayFromWordList(list, &lenList, onlyLineEnds);
+	words = new char *[lenList + 1];
+	capacity = lenList;
+	Rehash(lenList);
+	// Prefixes go first then other words, dropping any duplicates
+	for (int pass = 0; pass < 2; pass++) {
+		for (int i = 0; i < lenList; i++) {
+			if (((wordsList[i][0] == '^') == (pass == 0)) && (FindSlot(wordsList[i]) < 0)) {
+				words[len] = wordsList[i];
+				Insert(len);
+				len++;
+			}
+		}
+		if (pass == 0)
+			prefixes = len;
+	}
+	words[len] = emptyWord;
+	delete []wordsList;
+}
+
+/** Change to the words in s by adding and removing only the words that differ
+ * so that large lists which change a little are updated quickly.
+ * Returns true if any word was added or removed.
+ */
+bool WordList::Update(const char *s) {
+	WordList wlNew(onlyLineEnds);
+	wlNew.Set(s);
+	if (!words) {
+		if (!wlNew.len)
+			return false;
+		Set(s);
+		return true;
+	}
+	bool changed = false;
+	for (int i = len - 1; i >= 0; i--) {
+		if (wlNew.FindSlot(words[i]) < 0) {
+			Remove(words[i]);
+			changed = true;
+		}
+	}
+	for (int j = 0; j < wlNew.len; j++) {
+		if (FindSlot(wlNew.words[j]) < 0) {
+			Add(wlNew.words[j]);
+			changed = true;
+		}
+	}
+	return changed;
+}
+
+void WordList::Add(const char *word) {
+	if (!*word || (FindSlot(word) >= 0))
+		return;
+	if (len >= capacity) {
+		capacity = (capacity + 8) * 2;
+		char **wordsNew = new char *[capacity + 1];
+		for (int i = 0; i < len; i++)
+			wordsNew[i] = words[i];
+		delete []words;
+		words = wordsNew;
+	}
+	if ((tableUsed + 1) * 2 > tableSize)
+		Rehash(len + 1);
+	char *wordAdded = new char[strlen(word) + 1];
+	strcpy(wordAdded, word);
+	int index = len;
+	if (wordAdded[0] == '^') {
+		// Keep prefixes before other words
+		if (prefixes < len)
+			MoveWord(prefixes, len);
+		index = prefixes;
+		prefixes++;
 	}
+	words[index] = wordAdded;
+	Insert(index);
+	len++;
+	words[len] = emptyWord;
+}
+
+bool WordList::Remove(const char *word) {
+	int slot = FindSlot(word);
+	if (slot < 0)
+		return false;
+	int index = table[slot];
+	table[slot] = -2;
+	char *wordRemoved = words[index];
+	if (index < prefixes) {
+		// Fill the gap with the last prefix
+		prefixes--;
+		if (index < prefixes)
+			MoveWord(prefixes, index);
+		index = prefixes;
+	}
+	len--;
+	if (index < len)
+		MoveWord(len, index);
+	words[len] = emptyWord;
+	if (Owned(wordRemoved))
+		delete []wordRemoved;
+	return true;
 }
 
 /** Check whether a string is in the list.
@@ -132,36 +274,17 @@ void WordList::Set(const char *s) {
 bool WordList::InList(const char *s) const {
 	if (0 == words)
 		return false;
-	unsigned char firstChar = s[0];
-	int j = starts[firstChar];
-	if (j >= 0) {
-		while (static_cast<unsigned char>(words[j][0]) == firstChar) {
-			if (s[1] == words[j][1]) {
-				const char *a = words[j] + 1;
-				const char *b = s + 1;
-				while (*a && *a == *b) {
-					a++;
-					b++;
-				}
-				if (!*a && !*b)
-					return true;
-			}
-			j++;
-		}
-	}
-	j = starts['^'];
-	if (j >= 0) {
-		while (words[j][0] == '^') {
-			const char *a = words[j] + 1;
-			const char *b = s;
-			while (*a && *a == *b) {
-				a++;
-				b++;
-			}
-			if (!*a)
-				return true;
-			j++;
+	if (FindSlot(s) >= 0)
+		return true;
+	for (int j = 0; j < prefixes; j++) {
+		const char *a = words[j] + 1;
+		const char *b = s;
+		while (*a && *a == *b) {
+			a++;
+			b++;
 		}
+		if (!*a)
+			return true;
 	}
 	return false;
 }
@@ -174,46 +297,42 @@ bool WordList::InList(const char *s) const {
 bool WordList::InListAbbreviated(const char *s, const char marker) const {
 	if (0 == words)
 		return false;
+	if (FindSlot(s) >= 0)
+		return true;
 	unsigned char firstChar = s[0];
-	int j = starts[firstChar];
-	if (j >= 0) {
-		while (static_cast<unsigned char>(words[j][0]) == firstChar) {
-			bool isSubword = false;
-			int start = 1;
-			if (words[j][1] == marker) {
-				isSubword = true;
-				start++;
-			}
-			if (s[1] == words[j][start]) {
-				const char *a = words[j] + start;
-				const char *b = s + 1;
-				while (*a && *a == *b) {
-					a++;
-					if (*a == marker) {
-						isSubword = true;
-						a++;
-					}
-					b++;
-				}
-				if ((!*a || isSubword) && !*b)
-					return true;
-			}
-			j++;
+	for (int j = prefixes; j < len; j++) {
+		if (static_cast<unsigned char>(words[j][0]) != firstChar)
+			continue;
+		bool isSubword = false;
+		int start = 1;
+		if (words[j][1] == marker) {
+			isSubword = true;
+			start++;
 		}
-	}
-	j = starts['^'];
-	if (j >= 0) {
-		while (words[j][0] == '^') {
-			const char *a = words[j] + 1;
-			const char *b = s;
+		if (s[1] == words[j][start]) {
+			const char *a = words[j] + start;
+			const char *b = s + 1;
 			while (*a && *a == *b) {
 				a++;
+				if (*a == marker) {
+					isSubword = true;
+					a++;
+				}
 				b++;
 			}
-			if (!*a)
+			if ((!*a || isSubword) && !*b)
 				return true;
-			j++;
 		}
 	}
+	for (int j = 0; j < prefixes; j++) {
+		const char *a = words[j] + 1;
+		const char *b = s;
+		while (*a && *a == *b) {
+			a++;
+			b++;
+		}
+		if (!*a)
+			return true;
+	}
 	return false;
 }
@@ -13,25 +13,46 @@ namespace Scintilla {
 #endif
 
 /**
+ * Words are found through a hash table so large lists, such as the type names
+ * of a project, are fast to search and can be changed without being rebuilt.
  */
 class WordList {
 public:
 	// Each word contains at least one character - a empty word acts as sentinel at the end.
+	// Words starting with '^' are prefixes and are kept before the other words.
 	char **words;
 	char *list;
 	int len;
 	bool onlyLineEnds;	///< Delimited by any white space or only line ends
-	int starts[256];
 	WordList(bool onlyLineEnds_ = false) :
-		words(0), list(0), len(0), onlyLineEnds(onlyLineEnds_)
+		words(0), list(0), len(0), onlyLineEnds(onlyLineEnds_), listLength(0),
+		capacity(0), prefixes(0), table(0), tableSize(0), tableUsed(0)
 		{}
 	~WordList() { Clear(); }
 	operator bool() const { return len ? true : false; }
 	bool operator!=(const WordList &other) const;
 	void Clear();
 	void Set(const char *s);
+	bool Update(const char *s);
+	void Add(const char *word);
+	bool Remove(const char *word);
 	bool InList(const char *s) const;
 	bool InListAbbreviated(const char *s, const char marker) const;
+private:
+	int listLength;
+	int capacity;	///< Number of words that fit before words is reallocated
+	int prefixes;	///< Number of words starting with '^'
+	int *table;	///< Open addressed hash table of indices into words
+	int tableSize;	///< Power of 2 at least twice tableUsed
+	int tableUsed;	///< Including slots of removed words
+	bool Owned(const char *word) const;
+	int FindSlot(const char *word) const;
+	void Insert(int index);
+	void Rehash(int size);
+	void MoveWord(int from, int to);
+	// Private so WordList objects can not be copied
+	WordList(const WordList &);
+	WordList &operator=(const WordList &);
 };
 
 #ifdef SCI_NAMESPACE
@@ -10,6 +10,9 @@
 #include <stdio.h>
 #include <assert.h>
 
+#include <string>
+#include <vector>
+
 #include "Platform.h"
 
 #include "CharacterSet.h"
@@ -56,6 +59,8 @@ void AutoComplete::Start(Window &parent, int ctrlID,
 	}
 	lb->Create(parent, ctrlID, location, lineHeight, unicodeMode);
 	lb->Clear();
+	words.clear();
+	wordStarts.clear();
 	active = true;
 	startLen = startLen_;
 	posStart = position;
@@ -97,6 +102,25 @@ char AutoComplete::GetTypesep() const {
 
 void AutoComplete::SetList(const char *list) {
 	lb->SetList(list, separator, typesep);
+	// Keep a copy of the items, split in the same way as the list box, so that
+	// Select does not have to retrieve items from the platform list
+	words = list;
+	wordStarts.clear();
+	size_t startWord = 0;
+	size_t typeWord = std::string::npos;
+	for (size_t i = 0; i <= words.length(); i++) {
+		if ((i == words.length()) || (words[i] == separator)) {
+			if (typeWord != std::string::npos)
+				words[typeWord] = '\0';
+			if (i < words.length())
+				words[i] = '\0';
+			wordStarts.push_back(static_cast<int>(startWord));
+			startWord = i + 1;
+			typeWord = std::string::npos;
+		} else if (words[i] == typesep) {
+			typeWord = i;
+		}
+	}
 }
 
 void AutoComplete::Show(bool show) {
@@ -128,13 +152,11 @@ void AutoComplete::Move(int delta) {
 void AutoComplete::Select(const char *word) {
 	size_t lenWord = strlen(word);
 	int location = -1;
-	const int maxItemLen=1000;
 	int start = 0; // lower bound of the api array block to search
-	int end = lb->Length() - 1; // upper bound of the api array block to search
+	int end = static_cast<int>(wordStarts.size()) - 1; // upper bound of the api array block to search
 	while ((start <= end) && (location == -1)) { // Binary searching loop
 		int pivot = (start + end) / 2;
-		char item[maxItemLen];
-		lb->GetValue(pivot, item, maxItemLen);
+		const char *item = Item(pivot);
 		int cond;
 		if (ignoreCase)
 			cond = CompareNCaseInsensitive(word, item, lenWord);
@@ -143,7 +165,7 @@ void AutoComplete::Select(const char *word) {
 		if (!cond) {
 			// Find first match
 			while (pivot > start) {
-				lb->GetValue(pivot-1, item, maxItemLen);
+				item = Item(pivot-1);
 				if (ignoreCase)
 					cond = CompareNCaseInsensitive(word, item, lenWord);
 				else
@@ -156,7 +178,7 @@ void AutoComplete::Select(const char *word) {
 			if (ignoreCase) {
 				// Check for exact-case match
 				for (; pivot <= end; pivot++) {
-					lb->GetValue(pivot, item, maxItemLen);
+					item = Item(pivot);
 					if (!strncmp(word, item, lenWord)) {
 						location = pivot;
 						break;
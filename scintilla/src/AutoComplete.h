@@ -20,6 +20,12 @@ class AutoComplete {
 	char fillUpChars[256];
 	char separator;
 	char typesep; // Type seperator
+	std::string words;	///< The list items without their types, each terminated by NUL
+	std::vector<int> wordStarts;	///< Offset of each list item in words
+
+	const char *Item(int n) const {
+		return words.c_str() + wordStarts[n];
+	}
 
 public:
 	bool ignoreCase;
@@ -52,6 +52,18 @@ const LexerModule *Catalogue::Find(const char *languageName) {
 	return 0;
 }
 
+int Catalogue::Count() {
+	Scintilla_LinkLexers();
+	return static_cast<int>(lexerCatalogue.size());
+}
+
+const LexerModule *Catalogue::At(int index) {
+	Scintilla_LinkLexers();
+	if ((index >= 0) && (index < static_cast<int>(lexerCatalogue.size())))
+		return lexerCatalogue[index];
+	return 0;
+}
+
 void Catalogue::AddLexerModule(LexerModule *plm) {
 	if (plm->GetLanguage() == SCLEX_AUTOMATIC) {
 		plm->language = nextLanguage;
@@ -16,6 +16,8 @@ class Catalogue {
 public:
 	static const LexerModule *Find(int language);
 	static const LexerModule *Find(const char *languageName);
+	static int Count();
+	static const LexerModule *At(int index);
 	static void AddLexerModule(LexerModule *plm);
 };
 
@@ -53,6 +53,22 @@ void LineVector::InsertLine(int line, int position, bool lineStart) {
 	}
 }
 
+void LineVector::InsertLines(int line, const int *positions, int count, bool lineStart) {
+	starts.InsertPartitions(line, positions, count);
+	if (perLine) {
+		if ((line > 0) && lineStart)
+			line--;
+		for (int i = 0; i < count; i++) {
+			perLine->InsertLine(line + i);
+		}
+	}
+}
+
+// Make room for lines more lines
+void LineVector::AllocateLines(int lines) {
+	starts.ReservePartitions(lines);
+}
+
 void LineVector::SetLineStart(int line, int position) {
 	starts.SetPartitionStartPosition(line, position);
 }
@@ -329,12 +345,55 @@ void UndoHistory::CompletedRedoStep() {
 	currentAction++;
 }
 
+TextSnapshot::TextSnapshot(const char *text_, int length_) : refCount(1), ownsText(false) {
+	text = text_;
+	length = length_;
+}
+
+TextSnapshot::~TextSnapshot() {
+	if (ownsText)
+		delete []text;
+}
+
+void TextSnapshot::AddRef() {
+	Platform::AtomicIncrement(&refCount);
+}
+
+void TextSnapshot::Release() {
+	if (Platform::AtomicDecrementAndTest(&refCount))
+		delete this;
+}
+
+// Drop the buffer's reference before substance is changed. When other references
+// remain, take over the allocation holding the text and leave substance with a copy.
+// Only the owning thread adds references so a count above 1 can only fall meanwhile,
+// leaving an unneeded copy that is freed with the snapshot.
+void TextSnapshot::Detach(SplitVector<char> &substance) {
+	if (Platform::AtomicGet(&refCount) > 1) {
+		// text already points at the allocation substance gives up, readers may be using it
+		ownsText = substance.DetachBody() == text;
+		PLATFORM_ASSERT(ownsText);
+	}
+	if (Platform::AtomicDecrementAndTest(&refCount))
+		delete this;
+}
+
 CellBuffer::CellBuffer() {
 	readOnly = false;
 	collectingUndo = true;
+	snapshot = 0;
 }
 
 CellBuffer::~CellBuffer() {
+	Unshare();
+}
+
+// Must be called before anything that may move or free the text in substance.
+void CellBuffer::Unshare() {
+	if (snapshot) {
+		snapshot->Detach(substance);
+		snapshot = 0;
+	}
 }
 
 char CellBuffer::CharAt(int position) const {
@@ -372,9 +431,23 @@ void CellBuffer::GetStyleRange(unsigned char *buffer, int position, int lengthRe
 }
 
 const char *CellBuffer::BufferPointer() {
+	Unshare();
 	return substance.BufferPointer();
 }
 
+void CellBuffer::GetSegments(const char **segment1, int *length1, const char **segment2, int *length2) const {
+	substance.GetParts(segment1, length1, segment2, length2);
+}
+
+TextSnapshot *CellBuffer::CreateSnapshot() {
+	if (!snapshot) {
+		const char *text = substance.BufferPointer();
+		snapshot = new TextSnapshot(text, substance.Length());
+	}
+	snapshot->AddRef();
+	return snapshot;
+}
+
 // The char* returned is to an allocation owned by the undo history
 const char *CellBuffer::InsertString(int position, const char *s, int insertLength, bool &startSequence) {
 	char *data = 0;
@@ -446,6 +519,7 @@ int CellBuffer::Length() const {
 }
 
 void CellBuffer::Allocate(int newSize) {
+	Unshare();
 	substance.ReAllocate(newSize);
 	style.ReAllocate(newSize);
 }
@@ -493,11 +567,53 @@ void CellBuffer::RemoveLine(int line) {
 	lv.RemoveLine(line);
 }
 
+/**
+ * Finds the line ends in inserted text using memchr, which the C library vectorizes,
+ * to look for the next '\r' and the next '\n' separately.
+ */
+class LineEndFinder {
+	const char *s;
+	int length;
+	int nextCR;
+	int nextLF;
+	int Find(char ch, int start) const {
+		const void *found = memchr(s + start, ch, length - start);
+		return found ? static_cast<int>(static_cast<const char *>(found) - s) : length;
+	}
+public:
+	LineEndFinder(const char *s_, int length_) : s(s_), length(length_) {
+		nextCR = Find('\r', 0);
+		nextLF = Find('\n', 0);
+	}
+	/// Position of the current line end character or length when there are no more
+	int Current() const {
+		return (nextCR < nextLF) ? nextCR : nextLF;
+	}
+	void Advance() {
+		if (nextCR < nextLF)
+			nextCR = Find('\r', nextCR + 1);
+		else
+			nextLF = Find('\n', nextLF + 1);
+	}
+};
+
+// Number of lines started by line ends in s, counting "\r\n" once
+static int CountLineEnds(const char *s, int length) {
+	int lineEnds = 0;
+	for (LineEndFinder finder(s, length); finder.Current() < length; finder.Advance()) {
+		const int i = finder.Current();
+		if ((s[i] == '\r') || (i == 0) || (s[i-1] != '\r'))
+			lineEnds++;
+	}
+	return lineEnds;
+}
+
 void CellBuffer::BasicInsertString(int position, const char *s, int insertLength) {
 	if (insertLength == 0)
 		return;
 	PLATFORM_ASSERT(insertLength > 0);
 
+	Unshare();
 	substance.InsertFromArray(position, s, 0, insertLength);
 	style.InsertValue(position, insertLength, 0);
 
@@ -512,23 +628,34 @@ void CellBuffer::BasicInsertString(int position, const char *s, int insertLength
 		InsertLine(lineInsert, position, false);
 		lineInsert++;
 	}
-	char ch = ' ';
-	for (int i = 0; i < insertLength; i++) {
-		ch = s[i];
-		if (ch == '\r') {
-			InsertLine(lineInsert, (position + i) + 1, atLineStart);
-			lineInsert++;
-		} else if (ch == '\n') {
-			if (chPrev == '\r') {
-				// Patch up what was end of line
+	if (insertLength >= largeInsertion) {
+		lv.AllocateLines(CountLineEnds(s, insertLength));
+	}
+	// New line starts are collected and added to the line vector together
+	int lineStarts[lineStartsBatch];
+	int lineStartsPending = 0;
+	for (LineEndFinder finder(s, insertLength); finder.Current() < insertLength; finder.Advance()) {
+		const int i = finder.Current();
+		if ((s[i] == '\n') && (((i > 0) ? s[i-1] : chPrev) == '\r')) {
+			// Patch up what was end of line
+			if (lineStartsPending > 0)
+				lineStarts[lineStartsPending - 1] = (position + i) + 1;
+			else
 				lv.SetLineStart(lineInsert - 1, (position + i) + 1);
-			} else {
-				InsertLine(lineInsert, (position + i) + 1, atLineStart);
-				lineInsert++;
+		} else {
+			if (lineStartsPending == lineStartsBatch) {
+				lv.InsertLines(lineInsert, lineStarts, lineStartsPending, atLineStart);
+				lineInsert += lineStartsPending;
+				lineStartsPending = 0;
 			}
+			lineStarts[lineStartsPending++] = (position + i) + 1;
 		}
-		chPrev = ch;
 	}
+	if (lineStartsPending > 0) {
+		lv.InsertLines(lineInsert, lineStarts, lineStartsPending, atLineStart);
+		lineInsert += lineStartsPending;
+	}
+	const char ch = s[insertLength - 1];
 	// Joining two lines where last insertion is cr and following substance starts with lf
 	if (chAfter == '\n') {
 		if (ch == '\r') {
@@ -541,6 +668,7 @@ void CellBuffer::BasicInsertString(int position, const char *s, int insertLength
 void CellBuffer::BasicDeleteChars(int position, int deleteLength) {
 	if (deleteLength == 0)
 		return;
+	Unshare();
 
 	if ((position == 0) && (deleteLength == substance.Length())) {
 		// If whole buffer is being deleted, faster to reinitialise lines data
@@ -38,6 +38,8 @@ public:
 
 	void InsertText(int line, int delta);
 	void InsertLine(int line, int position, bool lineStart);
+	void InsertLines(int line, const int *positions, int count, bool lineStart);
+	void AllocateLines(int lines);
 	void SetLineStart(int line, int position);
 	void RemoveLine(int line);
 	int Lines() const {
@@ -126,6 +128,28 @@ public:
 	void CompletedRedoStep();
 };
 
+/**
+ * The text of a CellBuffer at one point in time which does not change when the buffer
+ * does. The text is shared with the buffer until the buffer is next changed.
+ * If the snapshot is still referenced then, it takes over the allocation and the buffer
+ * continues with a copy.
+ * Other threads may read and release a snapshot. It is only created and detached by
+ * the thread that changes the buffer.
+ */
+class TextSnapshot : public Sci_TextSnapshot {
+	int refCount;
+	bool ownsText;
+	~TextSnapshot();
+	// Private so TextSnapshot objects can not be copied
+	TextSnapshot(const TextSnapshot &);
+	TextSnapshot &operator=(const TextSnapshot &);
+public:
+	TextSnapshot(const char *text_, int length_);
+	void AddRef();
+	void Release();
+	void Detach(SplitVector<char> &substance);
+};
+
 /**
  * Holder for an expandable array of characters that supports undo and line markers.
  * Based on article "Data Structures in a Bit-Mapped Text Editor"
@@ -142,6 +166,13 @@ private:
 
 	LineVector lv;
 
+	TextSnapshot *snapshot;	///< Shares the text until it is next changed
+
+	void Unshare();
+
+	enum { lineStartsBatch = 0x400 };
+	enum { largeInsertion = 0x100000 };	///< Count the lines first to allocate for them at once
+
 	/// Actions without undo
 	void BasicInsertString(int position, const char *s, int insertLength);
 	void BasicDeleteChars(int position, int deleteLength);
@@ -157,6 +188,8 @@ public:
 	char StyleAt(int position) const;
 	void GetStyleRange(unsigned char *buffer, int position, int lengthRetrieve) const;
 	const char *BufferPointer();
+	void GetSegments(const char **segment1, int *length1, const char **segment2, int *length2) const;
+	TextSnapshot *CreateSnapshot();
 
 	int Length() const;
 	void Allocate(int newSize);
@@ -13,6 +13,8 @@
 
 #include <string>
 #include <vector>
+#include <map>
+#include <algorithm>
 
 #include "Platform.h"
 
@@ -69,22 +71,358 @@ void LexInterface::Colourise(int start, int end) {
 			end = lengthDoc;
 		int len = end - start;
 
+		// Folding is performed later, when fold levels are needed
+		InvalidateFolds(start);
+
 		PLATFORM_ASSERT(len >= 0);
 		PLATFORM_ASSERT(start + len <= lengthDoc);
 
+		if ((len > 0) && (instance->Version() >= lvLineStates) &&
+			(pdoc->RetainedEnd() > Platform::Maximum(start, pdoc->RetainedStart()))) {
+			start = ColouriseConverging(start, end);
+			len = end - start;
+		}
+
 		int styleStart = 0;
 		if (start > 0)
 			styleStart = pdoc->StyleAt(start - 1) & pdoc->stylingBitsMask;
 
 		if (len > 0) {
 			instance->Lex(start, len, styleStart, pdoc);
-			instance->Fold(start, len, styleStart, pdoc);
 		}
 
 		performingStyle = false;
 	}
 }
 
+// Lex from start in steps of a doubling number of lines. Once the state at the end of a
+// step in the text retained from before a change matches the state there before, the
+// retained styles and line states are still correct so lexing stops. Only used for
+// lexers that keep all their state in line states as others, such as those that
+// remember here document delimiters, may lex the same line end differently.
+// Returns the position from which any remainder up to end should be lexed.
+int LexInterface::ColouriseConverging(int start, int end) {
+	const int retainedStart = pdoc->RetainedStart();
+	const int retainedEnd = pdoc->RetainedEnd();
+	int line = pdoc->LineFromPosition(start);
+	int linesStep = 1;
+	while (start < end) {
+		line += linesStep;
+		linesStep *= 2;
+		const int lineStartPos = pdoc->LineStart(line);
+		const int endStep = Platform::Minimum(lineStartPos, end);
+		// Only the end of a whole line that was retained can be compared
+		const bool comparable = (endStep == lineStartPos) && (line < pdoc->LinesTotal()) &&
+			(endStep > retainedStart) && (endStep <= retainedEnd);
+		const char styleBefore = pdoc->StyleAt(endStep - 1);
+		const int stateBefore = pdoc->GetLineState(line - 1);
+
+		int styleStart = 0;
+		if (start > 0)
+			styleStart = pdoc->StyleAt(start - 1) & pdoc->stylingBitsMask;
+		instance->Lex(start, endStep - start, styleStart, pdoc);
+		start = endStep;
+
+		// A lexer that calls ChangeLexerState discards the retained styles
+		if (comparable && (pdoc->RetainedEnd() == retainedEnd) &&
+			(pdoc->StyleAt(endStep - 1) == styleBefore) &&
+			(pdoc->GetLineState(line - 1) == stateBefore)) {
+			pdoc->ReuseRetainedStyles();
+			return Platform::Maximum(start, pdoc->LineStart(pdoc->LineFromPosition(pdoc->GetEndStyled())));
+		}
+	}
+	return start;
+}
+
+// Fold from the end of the valid fold levels to the end of the line containing pos.
+// Styled text up to foldAhead further on is also folded so that looking at each line
+// in turn does not call the folder for every line.
+void LexInterface::FoldTo(int pos) {
+	if (!pdoc || !instance || performingStyle)
+		return;
+	int end = pdoc->LineStart(pdoc->LineFromPosition(pos) + 1);
+	if (end <= foldedTo)
+		return;
+	pdoc->EnsureStyledTo(end);
+	const int endStyled = pdoc->GetEndStyled();
+	const int lengthDoc = pdoc->Length();
+	const int endAhead = Platform::Minimum(endStyled, foldedTo + foldAhead);
+	end = Platform::Maximum(end, (endAhead >= lengthDoc) ? lengthDoc : pdoc->LineStart(pdoc->LineFromPosition(endAhead)));
+	if (end > endStyled)
+		end = (endStyled >= lengthDoc) ? lengthDoc : pdoc->LineStart(pdoc->LineFromPosition(endStyled));
+	if (end <= foldedTo)
+		return;
+	performingStyle = true;
+	int styleStart = 0;
+	if (foldedTo > 0)
+		styleStart = pdoc->StyleAt(foldedTo - 1) & pdoc->stylingBitsMask;
+	instance->Fold(foldedTo, end - foldedTo, styleStart, pdoc);
+	foldedTo = end;
+	performingStyle = false;
+}
+
+// Fold levels depend on the styles so are invalid from the line of a change.
+void LexInterface::InvalidateFolds(int pos) {
+	if (foldedTo > pos)
+		foldedTo = pdoc->LineStart(pdoc->LineFromPosition(pos));
+}
+
+void LexInterface::ModifiedAt(int pos) {
+	InvalidateFolds(pos);
+}
+
+/**
+ * The columns of character positions at intervals along a long line so that
+ * converting between positions and columns scans from the nearest checkpoint
+ * instead of from the start of the line. Checkpoints are added as the line is
+ * scanned and those after a change to the line are dropped.
+ */
+class ColumnCheckpoints {
+public:
+	int lineStart;	///< -1 when unused
+	int tabInChars;
+	int codePage;
+	std::vector<int> positions;	///< Offsets from lineStart with the first being 0
+	std::vector<int> columns;
+	enum { interval = 256 };
+
+	ColumnCheckpoints() : lineStart(-1), tabInChars(0), codePage(0) {
+	}
+	void Reset(int lineStart_, int tabInChars_, int codePage_) {
+		lineStart = lineStart_;
+		tabInChars = tabInChars_;
+		codePage = codePage_;
+		positions.clear();
+		columns.clear();
+		positions.push_back(0);
+		columns.push_back(0);
+	}
+	// Set position and column to the last checkpoint at or before position.
+	void BeforePosition(int &position, int &column) const {
+		const size_t i = std::upper_bound(positions.begin(), positions.end(),
+			position - lineStart) - positions.begin() - 1;
+		position = lineStart + positions[i];
+		column = columns[i];
+	}
+	// Set position and column to the last checkpoint at or before column.
+	void BeforeColumn(int &position, int &column) const {
+		const size_t i = std::upper_bound(columns.begin(), columns.end(), column) - columns.begin() - 1;
+		position = lineStart + positions[i];
+		column = columns[i];
+	}
+	void Add(int position, int column) {
+		if (position - lineStart >= positions.back() + interval) {
+			positions.push_back(position - lineStart);
+			columns.push_back(column);
+		}
+	}
+	void TextChanged(int pos, int lengthChange) {
+		if (lineStart < 0)
+			return;
+		if (pos < lineStart) {
+			if (pos - lengthChange >= lineStart) {
+				// Deleted the end of the previous line so this line may have joined it
+				lineStart = -1;
+			} else {
+				lineStart += lengthChange;
+			}
+		} else {
+			// Checkpoints before the change are still correct
+			size_t keep = std::lower_bound(positions.begin(), positions.end(),
+				pos - lineStart) - positions.begin();
+			if (keep < 1)
+				keep = 1;
+			positions.resize(keep);
+			columns.resize(keep);
+		}
+	}
+};
+
+/**
+ * Checkpoints for the few long lines most recently asked about, identified by
+ * the position at which they start.
+ */
+class ColumnCache {
+	enum { lines = 4 };
+	ColumnCheckpoints cache[lines];
+	int next;
+public:
+	ColumnCache() : next(0) {
+	}
+	// Shorter lines are as quick to scan as to look up
+	static bool Worthwhile(int lineLength) {
+		return lineLength >= 2 * ColumnCheckpoints::interval;
+	}
+	ColumnCheckpoints *ForLine(int lineStart, int tabInChars, int codePage) {
+		for (int i = 0; i < lines; i++) {
+			if (cache[i].lineStart == lineStart) {
+				if ((cache[i].tabInChars != tabInChars) || (cache[i].codePage != codePage))
+					cache[i].Reset(lineStart, tabInChars, codePage);
+				return &cache[i];
+			}
+		}
+		ColumnCheckpoints *lc = &cache[next];
+		next = (next + 1) % lines;
+		lc->Reset(lineStart, tabInChars, codePage);
+		return lc;
+	}
+	void TextChanged(int pos, int lengthChange) {
+		for (int i = 0; i < lines; i++) {
+			cache[i].TextChanged(pos, lengthChange);
+		}
+	}
+};
+
+static int BraceKind(char ch) {
+	switch (ch) {
+	case '(':
+	case ')':
+		return 0;
+	case '[':
+	case ']':
+		return 1;
+	case '{':
+	case '}':
+		return 2;
+	case '<':
+	case '>':
+		return 3;
+	default:
+		return -1;
+	}
+}
+
+static bool IsOpeningBrace(char ch) {
+	return ch == '(' || ch == '[' || ch == '{' || ch == '<';
+}
+
+/**
+ * The braces in the styled start of a document grouped by kind of brace and style.
+ * Each brace has a level: the nesting depth outside an opening brace or after a closing
+ * brace, counting only braces of its group. A brace matches the nearest brace of its
+ * group with the same level in the direction of the match, so matching is a binary search.
+ * The index is extended on demand and truncated at any change to text or styles.
+ */
+class BraceIndex {
+	struct Brace {
+		int position;
+		int group;
+		int level;
+		bool opening;
+	};
+	struct Group {
+		int depth;
+		std::map<int, std::vector<int> > levels;	///< Positions of the braces at each level
+		Group() : depth(0) {
+		}
+	};
+	std::vector<Brace> braces;
+	std::map<int, Group> groups;
+	int indexed;	///< Braces before this position are in the index
+	char styleMask;
+public:
+	enum { chunkSize = 0x40000 };
+	BraceIndex() : indexed(0), styleMask(0) {
+	}
+	int Indexed() const {
+		return indexed;
+	}
+	void Invalidate(int position) {
+		while (!braces.empty() && (braces.back().position >= position)) {
+			const Brace &brace = braces.back();
+			Group &group = groups[brace.group];
+			group.levels[brace.level].pop_back();
+			group.depth = brace.opening ? brace.level : brace.level + 1;
+			braces.pop_back();
+		}
+		if (indexed > position)
+			indexed = position;
+	}
+	void Extend(Document *pdoc, int end) {
+		const char mask = static_cast<char>(pdoc->stylingBitsMask);
+		if (styleMask != mask) {
+			Invalidate(0);
+			styleMask = mask;
+		}
+		for (int pos = indexed; pos < end; pos++) {
+			const char ch = pdoc->CharAt(pos);
+			const int kind = BraceKind(ch);
+			if (kind >= 0) {
+				Brace brace;
+				brace.position = pos;
+				brace.group = ((pdoc->StyleAt(pos) & mask) << 2) | kind;
+				brace.opening = IsOpeningBrace(ch);
+				Group &group = groups[brace.group];
+				if (brace.opening) {
+					brace.level = group.depth++;
+				} else {
+					brace.level = --group.depth;
+				}
+				group.levels[brace.level].push_back(pos);
+				braces.push_back(brace);
+			}
+		}
+		if (indexed < end)
+			indexed = end;
+	}
+	/**
+	 * Look up the brace at position which must have been indexed.
+	 * Returns the position of its match or -1 when none is indexed.
+	 * When none is found for an opening brace, depth is set to its nesting
+	 * depth at the end of the index.
+	 */
+	int Match(int position, int &depth) {
+		std::vector<Brace>::const_iterator it = std::lower_bound(braces.begin(), braces.end(), position, BraceBefore);
+		if ((it == braces.end()) || (it->position != position))
+			return -1;
+		Group &group = groups[it->group];
+		const std::vector<int> &sameLevel = group.levels[it->level];
+		std::vector<int>::const_iterator itLevel = std::lower_bound(sameLevel.begin(), sameLevel.end(), position);
+		int positionMatch = -1;
+		if (it->opening) {
+			++itLevel;
+			if (itLevel != sameLevel.end())
+				positionMatch = *itLevel;
+			else
+				depth = group.depth - it->level;
+		} else if (itLevel != sameLevel.begin()) {
+			--itLevel;
+			positionMatch = *itLevel;
+		}
+		if (positionMatch >= 0) {
+			// Neighbours on the same level are a pair when they face each other
+			std::vector<Brace>::const_iterator itMatch = std::lower_bound(braces.begin(), braces.end(), positionMatch, BraceBefore);
+			if (itMatch->opening == it->opening)
+				positionMatch = -1;
+		}
+		return positionMatch;
+	}
+private:
+	static bool BraceBefore(const Brace &brace, int position) {
+		return brace.position < position;
+	}
+};
+
+void ModificationBatch::Add(int modificationType_, int position, int length, int linesAdded_) {
+	const bool insertion = (modificationType_ & SC_MOD_INSERTTEXT) != 0;
+	if (modificationType == 0) {
+		start = position;
+		end = insertion ? position + length : position;
+		linesAdded = 0;
+	} else {
+		if (start > position)
+			start = position;
+		if (insertion)
+			end = (end >= position) ? end + length : position + length;
+		else
+			end = (end > position) ? Platform::Maximum(position, end - length) : position;
+	}
+	// Flags such as SC_STARTACTION describe a single step so are not summarised
+	modificationType |= modificationType_ &
+		(SC_MOD_INSERTTEXT | SC_MOD_DELETETEXT | SC_PERFORMED_USER | SC_PERFORMED_UNDO | SC_PERFORMED_REDO);
+	linesAdded += linesAdded_;
+}
+
 Document::Document() {
 	refCount = 0;
 #ifdef _WIN32
@@ -97,6 +435,8 @@ Document::Document() {
 	stylingBitsMask = 0x1F;
 	stylingMask = 0;
 	endStyled = 0;
+	retainedStart = 0;
+	retainedEnd = 0;
 	styleClock = 0;
 	enteredModification = 0;
 	enteredStyling = 0;
@@ -113,6 +453,9 @@ Document::Document() {
 	matchesValid = false;
 	regex = 0;
 
+	columnCache = new ColumnCache();
+	braceIndex = new BraceIndex();
+
 	perLineData[ldMarkers] = new LineMarkers();
 	perLineData[ldLevels] = new LineLevels();
 	perLineData[ldState] = new LineState();
@@ -137,6 +480,10 @@ Document::~Document() {
 	lenWatchers = 0;
 	delete regex;
 	regex = 0;
+	delete columnCache;
+	columnCache = 0;
+	delete braceIndex;
+	braceIndex = 0;
 	delete pli;
 	pli = 0;
 }
@@ -307,6 +654,8 @@ int SCI_METHOD Document::GetLevel(int line) const {
 
 void Document::ClearLevels() {
 	static_cast<LineLevels *>(perLineData[ldLevels])->ClearLevels();
+	if (pli)
+		pli->ModifiedAt(0);
 }
 
 static bool IsSubordinate(int levelStart, int levelTry) {
@@ -317,13 +666,14 @@ static bool IsSubordinate(int levelStart, int levelTry) {
 }
 
 int Document::GetLastChild(int lineParent, int level, int lastLine) {
+	EnsureFoldedTo(LineStart(lineParent + 1));
 	if (level == -1)
 		level = GetLevel(lineParent) & SC_FOLDLEVELNUMBERMASK;
 	int maxLine = LinesTotal();
 	int lookLastLine = (lastLine != -1) ? Platform::Minimum(LinesTotal() - 1, lastLine) : -1;
 	int lineMaxSubord = lineParent;
 	while (lineMaxSubord < maxLine - 1) {
-		EnsureStyledTo(LineStart(lineMaxSubord + 2));
+		EnsureFoldedTo(LineStart(lineMaxSubord + 2));
 		if (!IsSubordinate(level, GetLevel(lineMaxSubord + 1)))
 			break;
 		if ((lookLastLine != -1) && (lineMaxSubord >= lookLastLine) && !(GetLevel(lineMaxSubord) & SC_FOLDLEVELWHITEFLAG))
@@ -342,6 +692,7 @@ int Document::GetLastChild(int lineParent, int level, int lastLine) {
 }
 
 int Document::GetFoldParent(int line) {
+	EnsureFoldedTo(LineStart(line + 1));
 	int level = GetLevel(line) & SC_FOLDLEVELNUMBERMASK;
 	int lineLook = line - 1;
 	while ((lineLook > 0) && (
@@ -359,8 +710,9 @@ int Document::GetFoldParent(int line) {
 }
 
 void Document::GetHighlightDelimiters(HighlightDelimiter &highlightDelimiter, int line, int lastLine) {
-	int level = GetLevel(line);
 	int lookLastLine = Platform::Maximum(line, lastLine) + 1;
+	EnsureFoldedTo(LineStart(lookLastLine + 1));
+	int level = GetLevel(line);
 
 	int lookLine = line;
 	int lookLineLevel = level;
@@ -735,6 +1087,50 @@ int Document::SafeSegment(const char *text, int length, int lengthSegment) {
 void Document::ModifiedAt(int pos) {
 	if (endStyled > pos)
 		endStyled = pos;
+	if (retainedEnd > pos)
+		retainedEnd = pos;
+	if (pli)
+		pli->ModifiedAt(pos);
+}
+
+// Text was inserted (lengthChange > 0) or deleted at pos. The styles after the change
+// move with the text and are retained as lexing often reaches the same state there.
+// Splitting or joining lines leaves the states of the lines around the change with the
+// wrong lines so only lines after the one holding the end of the change are retained.
+void Document::TextModifiedAt(int pos, int lengthChange) {
+	columnCache->TextChanged(pos, lengthChange);
+	const int startAfter = LineStart(LineFromPosition(pos + Platform::Maximum(lengthChange, 0)) + 1);
+	int end = Platform::Maximum(endStyled, retainedEnd);
+	if (end > pos)
+		end = Platform::Maximum(end + lengthChange, pos);
+	int start = startAfter;
+	if ((retainedEnd > endStyled) && (retainedStart > pos))
+		start = Platform::Maximum(retainedStart + lengthChange, startAfter);
+	ModifiedAt(pos);
+	retainedStart = start;
+	retainedEnd = end;
+}
+
+// Lexing has reached the same state as before the text changed so the retained styles are correct.
+void Document::ReuseRetainedStyles() {
+	if (retainedEnd > endStyled)
+		endStyled = retainedEnd;
+}
+
+void Document::BeginBatch() {
+	batch.depth++;
+}
+
+// When the outermost batch ends, tell the watchers about all its text changes at once.
+void Document::EndBatch() {
+	if (batch.depth > 0)
+		batch.depth--;
+	if ((batch.depth == 0) && batch.modificationType) {
+		DocModification mh(SC_MOD_COALESCED | batch.modificationType,
+			batch.start, batch.end - batch.start, batch.linesAdded);
+		batch.modificationType = 0;
+		NotifyModified(mh);
+	}
 }
 
 void Document::CheckReadOnly() {
@@ -771,7 +1167,7 @@ bool Document::DeleteChars(int pos, int len) {
 			if (startSavePoint && cb.IsCollectingUndo())
 				NotifySavePoint(!startSavePoint);
 			if ((pos < Length()) || (pos == 0))
-				ModifiedAt(pos);
+				TextModifiedAt(pos, -len);
 			else
 				ModifiedAt(pos-1);
 			NotifyModified(
@@ -809,7 +1205,7 @@ bool Document::InsertString(int position, const char *s, int insertLength) {
 			const char *text = cb.InsertString(position, s, insertLength, startSequence);
 			if (startSavePoint && cb.IsCollectingUndo())
 				NotifySavePoint(!startSavePoint);
-			ModifiedAt(position);
+			TextModifiedAt(position, insertLength);
 			NotifyModified(
 			    DocModification(
 			        SC_MOD_INSERTTEXT | SC_PERFORMED_USER | (startSequence?SC_STARTACTION:0),
@@ -831,6 +1227,7 @@ int Document::Undo() {
 			bool multiLine = false;
 			int steps = cb.StartUndo();
 			//Platform::DebugPrintf("Steps=%d\n", steps);
+			BeginBatch();
 			for (int step = 0; step < steps; step++) {
 				const int prevLinesTotal = LinesTotal();
 				const Action &action = cb.GetUndoStep();
@@ -848,7 +1245,8 @@ int Document::Undo() {
 				cb.PerformUndoStep();
 				int cellPosition = action.position;
 				if (action.at != containerAction) {
-					ModifiedAt(cellPosition);
+					TextModifiedAt(cellPosition,
+						(action.at == removeAction) ? action.lenData : -action.lenData);
 					newPos = cellPosition;
 				}
 
@@ -873,6 +1271,7 @@ int Document::Undo() {
 				NotifyModified(DocModification(modFlags, cellPosition, action.lenData,
 											   linesAdded, action.data));
 			}
+			EndBatch();
 
 			bool endSavePoint = cb.IsSavePoint();
 			if (startSavePoint != endSavePoint)
@@ -892,6 +1291,7 @@ int Document::Redo() {
 			bool startSavePoint = cb.IsSavePoint();
 			bool multiLine = false;
 			int steps = cb.StartRedo();
+			BeginBatch();
 			for (int step = 0; step < steps; step++) {
 				const int prevLinesTotal = LinesTotal();
 				const Action &action = cb.GetRedoStep();
@@ -908,7 +1308,8 @@ int Document::Redo() {
 				}
 				cb.PerformRedoStep();
 				if (action.at != containerAction) {
-					ModifiedAt(action.position);
+					TextModifiedAt(action.position,
+						(action.at == insertAction) ? action.lenData : -action.lenData);
 					newPos = action.position;
 				}
 
@@ -933,6 +1334,7 @@ int Document::Redo() {
 					DocModification(modFlags, action.position, action.lenData,
 									linesAdded, action.data));
 			}
+			EndBatch();
 
 			bool endSavePoint = cb.IsSavePoint();
 			if (startSavePoint != endSavePoint)
@@ -1054,7 +1456,16 @@ int Document::GetColumn(int pos) {
 	int column = 0;
 	int line = LineFromPosition(pos);
 	if ((line >= 0) && (line < LinesTotal())) {
-		for (int i = LineStart(line); i < pos;) {
+		int i = LineStart(line);
+		ColumnCheckpoints *checkpoints = 0;
+		if (ColumnCache::Worthwhile(LineStart(line + 1) - i)) {
+			checkpoints = columnCache->ForLine(i, tabInChars, dbcsCodePage);
+			i = pos;
+			checkpoints->BeforePosition(i, column);
+		}
+		while (i < pos) {
+			if (checkpoints)
+				checkpoints->Add(i, column);
 			char ch = cb.CharAt(i);
 			if (ch == '\t') {
 				column = NextTab(column, tabInChars);
@@ -1078,7 +1489,15 @@ int Document::FindColumn(int line, int column) {
 	int position = LineStart(line);
 	if ((line >= 0) && (line < LinesTotal())) {
 		int columnCurrent = 0;
+		ColumnCheckpoints *checkpoints = 0;
+		if ((column > 0) && ColumnCache::Worthwhile(LineStart(line + 1) - position)) {
+			checkpoints = columnCache->ForLine(position, tabInChars, dbcsCodePage);
+			columnCurrent = column;
+			checkpoints->BeforeColumn(position, columnCurrent);
+		}
 		while ((columnCurrent < column) && (position < Length())) {
+			if (checkpoints)
+				checkpoints->Add(position, columnCurrent);
 			char ch = cb.CharAt(position);
 			if (ch == '\t') {
 				columnCurrent = NextTab(columnCurrent, tabInChars);
@@ -1662,7 +2081,17 @@ void Document::EnsureStyledTo(int pos) {
 	}
 }
 
+// Fold levels are only computed when something looks at them, such as a fold margin,
+// a fold command or the container asking for the level of a line.
+void Document::EnsureFoldedTo(int pos) {
+	if (pli && !pli->UseContainerLexing())
+		pli->FoldTo(pos);
+}
+
 void Document::LexerChanged() {
+	retainedEnd = 0;
+	if (pli)
+		pli->ModifiedAt(0);
 	// Tell the watchers the lexer has changed.
 	for (int i = 0; i < lenWatchers; i++) {
 		watchers[i].watcher->NotifyLexerChanged(this, watchers[i].userData);
@@ -1687,6 +2116,8 @@ int Document::GetMaxLineState() {
 }
 
 void SCI_METHOD Document::ChangeLexerState(int start, int end) {
+	// Text after the change may now be lexed differently
+	retainedEnd = 0;
 	DocModification mh(SC_MOD_LEXERSTATE, start, end-start, 0, 0, 0);
 	NotifyModified(mh);
 }
@@ -1833,10 +2264,16 @@ void Document::NotifySavePoint(bool atSavePoint) {
 }
 
 void Document::NotifyModified(DocModification mh) {
-	if (mh.modificationType & SC_MOD_INSERTTEXT) {
-		decorations.InsertSpace(mh.position, mh.length);
-	} else if (mh.modificationType & SC_MOD_DELETETEXT) {
-		decorations.DeleteRange(mh.position, mh.length);
+	if (!(mh.modificationType & SC_MOD_COALESCED)) {
+		if (mh.modificationType & SC_MOD_INSERTTEXT) {
+			decorations.InsertSpace(mh.position, mh.length);
+		} else if (mh.modificationType & SC_MOD_DELETETEXT) {
+			decorations.DeleteRange(mh.position, mh.length);
+		}
+		if (mh.modificationType & (SC_MOD_INSERTTEXT | SC_MOD_DELETETEXT | SC_MOD_CHANGESTYLE))
+			braceIndex->Invalidate(mh.position);
+		if (batch.depth && (mh.modificationType & (SC_MOD_INSERTTEXT | SC_MOD_DELETETEXT)))
+			batch.Add(mh.modificationType, mh.position, mh.length, mh.linesAdded);
 	}
 	for (int i = 0; i < lenWatchers; i++) {
 		watchers[i].watcher->NotifyModified(this, mh, watchers[i].userData);
@@ -1988,7 +2425,31 @@ int Document::BraceMatch(int position, int /*maxReStyle*/) {
 	if (chBrace == '(' || chBrace == '[' || chBrace == '{' || chBrace == '<')
 		direction = 1;
 	int depth = 1;
-	position = NextPosition(position, direction);
+	const int endIndex = GetEndStyled();
+	// Brace characters may be trail bytes in DBCS so only index other encodings
+	if ((!dbcsCodePage || (dbcsCodePage == SC_CP_UTF8)) && (position < endIndex)) {
+		braceIndex->Invalidate(endIndex);
+		int extent = BraceIndex::chunkSize;
+		if (braceIndex->Indexed() <= position)
+			braceIndex->Extend(this, Platform::Minimum(position + extent, endIndex));
+		for (;;) {
+			int positionMatch = braceIndex->Match(position, depth);
+			if ((positionMatch >= 0) || (direction < 0))
+				return positionMatch;
+			if (braceIndex->Indexed() >= endIndex)
+				break;
+			extent *= 2;
+			braceIndex->Extend(this, Platform::Minimum(braceIndex->Indexed() + extent, endIndex));
+		}
+		// Continue through the unstyled text
+		position = endIndex;
+	} else {
+		position = NextPosition(position, direction);
+	}
+	return BraceMatchScan(chBrace, chSeek, styBrace, position, direction, depth);
+}
+
+int Document::BraceMatchScan(char chBrace, char chSeek, char styBrace, int position, int direction, int depth) {
 	while ((position >= 0) && (position < Length())) {
 		char chAtPos = CharAt(position);
 		char styAtPos = static_cast<char>(StyleAt(position) & stylingBitsMask);
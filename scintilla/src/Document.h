@@ -174,26 +174,50 @@ public:
 };
 
 class Document;
+class ColumnCache;
+class BraceIndex;
 
 class LexInterface {
 protected:
 	Document *pdoc;
 	ILexer *instance;
 	bool performingStyle;	///< Prevent reentrance
+	int foldedTo;	///< Fold levels are valid before this line start
+	enum { foldAhead = 0x4000 };
+	void InvalidateFolds(int pos);
 public:
-	LexInterface(Document *pdoc_) : pdoc(pdoc_), instance(0), performingStyle(false) {
+	LexInterface(Document *pdoc_) : pdoc(pdoc_), instance(0), performingStyle(false), foldedTo(0) {
 	}
 	virtual ~LexInterface() {
 	}
 	void Colourise(int start, int end);
+	int ColouriseConverging(int start, int end);
+	void FoldTo(int pos);
 	bool UseContainerLexing() const {
 		return instance == 0;
 	}
+	void ModifiedAt(int pos);
 };
 
 /**
+ * The extent of the text changes made while an undo group is open or a multiple step
+ * undo or redo is performed so they can be reported once when it completes.
  */
-class Document : PerLine, public IDocument {
+class ModificationBatch {
+public:
+	int depth;
+	int modificationType;	///< Union of the flags of the text changes, 0 when there are none
+	int start;	///< The changes are all within start..end of the current text
+	int end;
+	int linesAdded;
+	ModificationBatch() : depth(0), modificationType(0), start(0), end(0), linesAdded(0) {
+	}
+	void Add(int modificationType_, int position, int length, int linesAdded_);
+};
+
+/**
+ */
+class Document : PerLine, public IDocumentWithSegments {
 
 public:
 	/** Used to pair watcher pointer with user data. */
@@ -214,10 +238,13 @@ private:
 	CharClassify charClass;
 	char stylingMask;
 	int endStyled;
+	int retainedStart;	///< Styles from retainedStart to retainedEnd are from before recent text changes
+	int retainedEnd;
 	int styleClock;
 	int enteredModification;
 	int enteredStyling;
 	int enteredReadOnlyCount;
+	ModificationBatch batch;
 
 	WatcherWithUserData *watchers;
 	int lenWatchers;
@@ -229,6 +256,9 @@ private:
 	bool matchesValid;
 	RegexSearchBase *regex;
 
+	ColumnCache *columnCache;
+	BraceIndex *braceIndex;
+
 public:
 
 	LexInterface *pli;
@@ -259,7 +289,7 @@ public:
 	virtual void RemoveLine(int line);
 
 	int SCI_METHOD Version() const {
-		return dvOriginal;
+		return dvSegments;
 	}
 
 	void SCI_METHOD SetErrorStatus(int status);
@@ -278,6 +308,7 @@ public:
 
 	// Gateways to modifying document
 	void ModifiedAt(int pos);
+	void TextModifiedAt(int pos, int lengthChange);
 	void CheckReadOnly();
 	bool DeleteChars(int pos, int len);
 	bool InsertString(int position, const char *s, int insertLength);
@@ -290,12 +321,19 @@ public:
 		return cb.SetUndoCollection(collectUndo);
 	}
 	bool IsCollectingUndo() { return cb.IsCollectingUndo(); }
-	void BeginUndoAction() { cb.BeginUndoAction(); }
-	void EndUndoAction() { cb.EndUndoAction(); }
+	void BeginUndoAction() { cb.BeginUndoAction(); BeginBatch(); }
+	void EndUndoAction() { cb.EndUndoAction(); EndBatch(); }
+	void BeginBatch();
+	void EndBatch();
+	bool InBatch() const { return batch.depth > 0; }
 	void AddUndoAction(int token, bool mayCoalesce) { cb.AddUndoAction(token, mayCoalesce); }
 	void SetSavePoint();
 	bool IsSavePoint() { return cb.IsSavePoint(); }
 	const char * SCI_METHOD BufferPointer() { return cb.BufferPointer(); }
+	TextSnapshot *CreateTextSnapshot() { return cb.CreateSnapshot(); }
+	void SCI_METHOD GetSegments(const char **segment1, int *length1, const char **segment2, int *length2) {
+		cb.GetSegments(segment1, length1, segment2, length2);
+	}
 
 	int SCI_METHOD GetLineIndentation(int line);
 	void SetLineIndentation(int line, int indent);
@@ -364,7 +402,11 @@ public:
 	bool SCI_METHOD SetStyleFor(int length, char style);
 	bool SCI_METHOD SetStyles(int length, const char *styles);
 	int GetEndStyled() { return endStyled; }
+	int RetainedStart() const { return retainedStart; }
+	int RetainedEnd() const { return retainedEnd; }
+	void ReuseRetainedStyles();
 	void EnsureStyledTo(int pos);
+	void EnsureFoldedTo(int pos);
 	void LexerChanged();
 	int GetStyleClock() { return styleClock; }
 	void IncrementStyleClock();
@@ -411,6 +453,7 @@ public:
 	int BraceMatch(int position, int maxReStyle);
 
 private:
+	int BraceMatchScan(char chBrace, char chSeek, char styBrace, int position, int direction, int depth);
 	bool IsWordStartAt(int pos);
 	bool IsWordEndAt(int pos);
 	bool IsWordAt(int start, int end);
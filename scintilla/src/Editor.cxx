@@ -84,6 +84,118 @@ Timer::Timer() :
 Idler::Idler() :
 		state(false), idlerID(0) {}
 
+MarginRowCache::MarginRowCache() : rows(0), lines(0), margins(0), topLine(0) {
+}
+
+MarginRowCache::~MarginRowCache() {
+	delete []rows;
+	rows = 0;
+}
+
+void MarginRowCache::Allocate(int lines_, int margins_) {
+	if ((lines != lines_) || (margins != margins_)) {
+		delete []rows;
+		rows = 0;
+		lines = lines_;
+		margins = margins_;
+		if (lines * margins > 0)
+			rows = new MarginRow[lines * margins];
+	}
+	Invalidate();
+}
+
+void MarginRowCache::Invalidate() {
+	for (int i = 0; i < lines * margins; i++) {
+		rows[i] = MarginRow();
+	}
+}
+
+void MarginRowCache::InvalidateLine(int line, bool allAfter) {
+	for (int i = 0; i < lines * margins; i++) {
+		if ((rows[i].line == line) || (allAfter && ((rows[i].line >= line) || (rows[i].line == -1)))) {
+			rows[i] = MarginRow();
+		}
+	}
+}
+
+// Move the remembered rows to match a pixmap moved up by linesUp rows (down when negative)
+void MarginRowCache::Scroll(int linesUp) {
+	if (linesUp > 0) {
+		for (int row = 0; row < lines; row++) {
+			for (int margin = 0; margin < margins; margin++) {
+				if (row + linesUp < lines)
+					rows[row * margins + margin] = rows[(row + linesUp) * margins + margin];
+				else
+					rows[row * margins + margin] = MarginRow();
+			}
+		}
+	} else if (linesUp < 0) {
+		for (int row = lines - 1; row >= 0; row--) {
+			for (int margin = 0; margin < margins; margin++) {
+				if (row + linesUp >= 0)
+					rows[row * margins + margin] = rows[(row + linesUp) * margins + margin];
+				else
+					rows[row * margins + margin] = MarginRow();
+			}
+		}
+	}
+}
+
+bool MarginRowCache::Matches(int row, int margin, const MarginRow &mr) const {
+	if ((row >= 0) && (row < lines) && (margin >= 0) && (margin < margins))
+		return rows[row * margins + margin] == mr;
+	else
+		return false;
+}
+
+void MarginRowCache::Set(int row, int margin, const MarginRow &mr) {
+	if ((row >= 0) && (row < lines) && (margin >= 0) && (margin < margins))
+		rows[row * margins + margin] = mr;
+}
+
+int PaintStatistics::Value(int statistic) const {
+	if ((statistic < 0) || (statistic >= statistics))
+		return 0;
+	if (statistic <= SC_PAINTSTAT_DRAWTIME)
+		return static_cast<int>(values[statistic] * 1000000.0);
+	return static_cast<int>(values[statistic]);
+}
+
+DeferredSelection::DeferredSelection(TextSnapshot *snapshot_, const std::vector<SelectionRange> &ranges_,
+	int eolMode_, bool lineEnds_, int codePage_, int characterSet_, bool rectangular_, bool lineCopy_) :
+	snapshot(snapshot_), ranges(ranges_), eolMode(eolMode_), lineEnds(lineEnds_),
+	codePage(codePage_), characterSet(characterSet_), rectangular(rectangular_), lineCopy(lineCopy_) {
+}
+
+DeferredSelection::~DeferredSelection() {
+	snapshot->Release();
+}
+
+// Join the text of the ranges in the same way as Editor::CopySelectionRange.
+char *DeferredSelection::Retrieve(int *length) const {
+	const int delimiterLength = lineEnds ? ((eolMode == SC_EOL_CRLF) ? 2 : 1) : 0;
+	size_t size = 0;
+	for (size_t r = 0; r < ranges.size(); r++)
+		size += ranges[r].End().Position() - ranges[r].Start().Position() + delimiterLength;
+	char *text = new char[size + 1];
+	size_t j = 0;
+	for (size_t r = 0; r < ranges.size(); r++) {
+		const int start = ranges[r].Start().Position();
+		const int rangeLength = ranges[r].End().Position() - start;
+		memcpy(text + j, snapshot->text + start, rangeLength);
+		j += rangeLength;
+		if (lineEnds) {
+			if (eolMode != SC_EOL_LF)
+				text[j++] = '\r';
+			if (eolMode != SC_EOL_CR)
+				text[j++] = '\n';
+		}
+	}
+	text[size] = '\0';
+	*length = static_cast<int>(size + 1);
+	return text;
+}
+
 static inline bool IsControlCharacter(int ch) {
 	// iscntrl returns true for lots of chars > 127 which are displayable
 	return ch >= 0 && ch < ' ';
@@ -139,6 +251,7 @@ Editor::Editor() {
 	wordSelectInitialCaretPos = -1;
 
 	primarySelection = true;
+	selectionsPlaced = false;
 
 	caretXPolicy = CARET_SLOP | CARET_EVEN;
 	caretXSlop = 50;
@@ -170,7 +283,9 @@ Editor::Editor() {
 
 	pixmapLine = Surface::Allocate();
 	pixmapSelMargin = Surface::Allocate();
+	pixmapSelMarginScroll = Surface::Allocate();
 	pixmapSelPattern = Surface::Allocate();
+	pixmapSelPatternOffset = Surface::Allocate();
 	pixmapIndentGuide = Surface::Allocate();
 	pixmapIndentGuideHighlight = Surface::Allocate();
 
@@ -195,6 +310,7 @@ Editor::Editor() {
 	paintState = notPainting;
 
 	modEventMask = SC_MODEVENTMASKALL;
+	coalesceModEvents = false;
 
 	pdoc = new Document();
 	pdoc->AddRef();
@@ -215,6 +331,8 @@ Editor::Editor() {
 
 	convertPastes = true;
 
+	idleStyling = SC_IDLESTYLING_NONE;
+
 	hsStart = -1;
 	hsEnd = -1;
 
@@ -229,7 +347,9 @@ Editor::~Editor() {
 	DropGraphics();
 	delete pixmapLine;
 	delete pixmapSelMargin;
+	delete pixmapSelMarginScroll;
 	delete pixmapSelPattern;
+	delete pixmapSelPatternOffset;
 	delete pixmapIndentGuide;
 	delete pixmapIndentGuideHighlight;
 }
@@ -242,9 +362,12 @@ void Editor::Finalise() {
 void Editor::DropGraphics() {
 	pixmapLine->Release();
 	pixmapSelMargin->Release();
+	pixmapSelMarginScroll->Release();
 	pixmapSelPattern->Release();
+	pixmapSelPatternOffset->Release();
 	pixmapIndentGuide->Release();
 	pixmapIndentGuideHighlight->Release();
+	marginRows.Invalidate();
 }
 
 void Editor::InvalidateStyleData() {
@@ -398,8 +521,8 @@ Point Editor::LocationFromPosition(SelectionPosition pos) {
 		pt.y = (lineVisible - topLine - 1) * vs.lineHeight;
 		pt.x = 0;
 		unsigned int posLineStart = pdoc->LineStart(line);
-		LayoutLine(line, surface, vs, ll, wrapWidth);
-		int posInLine = pos.Position() - posLineStart;
+		LayoutLine(line, surface, vs, ll, wrapWidth, pos.Position() - posLineStart);
+		int posInLine = pos.Position() - posLineStart - ll->windowStart;
 		// In case of very long line put x at arbitrary large position
 		if (posInLine > ll->maxLineLength) {
 			pt.x = ll->positions[ll->maxLineLength] - ll->positions[ll->LineStart(ll->lines)];
@@ -407,7 +530,7 @@ Point Editor::LocationFromPosition(SelectionPosition pos) {
 
 		for (int subLine = 0; subLine < ll->lines; subLine++) {
 			if ((posInLine >= ll->LineStart(subLine)) && (posInLine <= ll->LineStart(subLine + 1))) {
-				pt.x = ll->positions[posInLine] - ll->positions[ll->LineStart(subLine)];
+				pt.x = ll->positions[posInLine] - ll->SubLineStart(subLine);
 				if (ll->wrapIndent != 0) {
 					int lineStart = ll->LineStart(subLine);
 					if (lineStart != 0)	// Wrapped
@@ -478,13 +601,14 @@ SelectionPosition Editor::SPositionFromLocation(Point pt, bool canReturnInvalid,
 	AutoSurface surface(this);
 	AutoLineLayout ll(llc, RetrieveLineLayout(lineDoc));
 	if (surface && ll) {
-		LayoutLine(lineDoc, surface, vs, ll, wrapWidth);
+		LayoutLine(lineDoc, surface, vs, ll, wrapWidth, -1, Platform::Maximum(pt.x, 0));
+		const int posLayoutStart = posLineStart + ll->windowStart;
 		int lineStartSet = cs.DisplayFromDoc(lineDoc);
 		int subLine = visibleLine - lineStartSet;
 		if (subLine < ll->lines) {
 			int lineStart = ll->LineStart(subLine);
 			int lineEnd = ll->LineLastVisible(subLine);
-			int subLineStart = ll->positions[lineStart];
+			int subLineStart = ll->SubLineStart(subLine);
 
 			if (ll->wrapIndent != 0) {
 				if (lineStart != 0)	// Wrapped
@@ -494,11 +618,11 @@ SelectionPosition Editor::SPositionFromLocation(Point pt, bool canReturnInvalid,
 			while (i < lineEnd) {
 				if (charPosition) {
 					if ((pt.x + subLineStart) < (ll->positions[i + 1])) {
-						return SelectionPosition(pdoc->MovePositionOutsideChar(i + posLineStart, 1));
+						return SelectionPosition(pdoc->MovePositionOutsideChar(i + posLayoutStart, 1));
 					}
 				} else {
 					if ((pt.x + subLineStart) < ((ll->positions[i] + ll->positions[i + 1]) / 2)) {
-						return SelectionPosition(pdoc->MovePositionOutsideChar(i + posLineStart, 1));
+						return SelectionPosition(pdoc->MovePositionOutsideChar(i + posLayoutStart, 1));
 					}
 				}
 				i++;
@@ -507,17 +631,17 @@ SelectionPosition Editor::SPositionFromLocation(Point pt, bool canReturnInvalid,
 				const int spaceWidth = static_cast<int>(vs.styles[ll->EndLineStyle()].spaceWidth);
 				int spaceOffset = (pt.x + subLineStart - ll->positions[lineEnd] + spaceWidth / 2) /
 					spaceWidth;
-				return SelectionPosition(lineEnd + posLineStart, spaceOffset);
+				return SelectionPosition(lineEnd + posLayoutStart, spaceOffset);
 			} else if (canReturnInvalid) {
 				if (pt.x < (ll->positions[lineEnd] - subLineStart)) {
-					return SelectionPosition(pdoc->MovePositionOutsideChar(lineEnd + posLineStart, 1));
+					return SelectionPosition(pdoc->MovePositionOutsideChar(lineEnd + posLayoutStart, 1));
 				}
 			} else {
-				return SelectionPosition(lineEnd + posLineStart);
+				return SelectionPosition(lineEnd + posLayoutStart);
 			}
 		}
 		if (!canReturnInvalid)
-			return SelectionPosition(ll->numCharsInLine + posLineStart);
+			return SelectionPosition(ll->numCharsInLine + posLayoutStart);
 	}
 	return retVal;
 }
@@ -539,13 +663,13 @@ int Editor::PositionFromLineX(int lineDoc, int x) {
 	AutoLineLayout ll(llc, RetrieveLineLayout(lineDoc));
 	int retVal = 0;
 	if (surface && ll) {
-		unsigned int posLineStart = pdoc->LineStart(lineDoc);
-		LayoutLine(lineDoc, surface, vs, ll, wrapWidth);
+		LayoutLine(lineDoc, surface, vs, ll, wrapWidth, -1, Platform::Maximum(x, 0));
+		unsigned int posLineStart = pdoc->LineStart(lineDoc) + ll->windowStart;
 		retVal = ll->numCharsBeforeEOL + posLineStart;
 		int subLine = 0;
 		int lineStart = ll->LineStart(subLine);
 		int lineEnd = ll->LineLastVisible(subLine);
-		int subLineStart = ll->positions[lineStart];
+		int subLineStart = ll->SubLineStart(subLine);
 
 		if (ll->wrapIndent != 0) {
 			if (lineStart != 0)	// Wrapped
@@ -576,12 +700,12 @@ SelectionPosition Editor::SPositionFromLineX(int lineDoc, int x) {
 	AutoLineLayout ll(llc, RetrieveLineLayout(lineDoc));
 	int retVal = 0;
 	if (surface && ll) {
-		unsigned int posLineStart = pdoc->LineStart(lineDoc);
-		LayoutLine(lineDoc, surface, vs, ll, wrapWidth);
+		LayoutLine(lineDoc, surface, vs, ll, wrapWidth, -1, Platform::Maximum(x, 0));
+		unsigned int posLineStart = pdoc->LineStart(lineDoc) + ll->windowStart;
 		int subLine = 0;
 		int lineStart = ll->LineStart(subLine);
 		int lineEnd = ll->LineLastVisible(subLine);
-		int subLineStart = ll->positions[lineStart];
+		int subLineStart = ll->SubLineStart(subLine);
 
 		if (ll->wrapIndent != 0) {
 			if (lineStart != 0)	// Wrapped
@@ -640,6 +764,10 @@ void Editor::Redraw() {
 }
 
 void Editor::RedrawSelMargin(int line, bool allAfter) {
+	if (line == -1)
+		marginRows.Invalidate();
+	else
+		marginRows.InvalidateLine(line, allAfter);
 	if (!AbandonPaint()) {
 		if (vs.maskInLine) {
 			Redraw();
@@ -713,15 +841,35 @@ void Editor::SetRectangularRange() {
 		int lineAnchorRect = pdoc->LineFromPosition(sel.Rectangular().anchor.Position());
 		int lineCaret = pdoc->LineFromPosition(sel.Rectangular().caret.Position());
 		int increment = (lineCaret > lineAnchorRect) ? 1 : -1;
-		for (int line=lineAnchorRect; line != lineCaret+increment; line += increment) {
+		const bool virtualSpace = (virtualSpaceOptions & SCVS_RECTANGULARSELECTION) != 0;
+		// Retain the lines still in the rectangle when only its caret line moved
+		int linesKept = 0;
+		const int linesBuilt = abs(rectangularBuild.lineCaret - rectangularBuild.lineAnchor) + 1;
+		if (sel.LinesOrdered() && (sel.Count() == static_cast<size_t>(linesBuilt)) &&
+			(rectangularBuild.lineAnchor == lineAnchorRect) &&
+			(rectangularBuild.xAnchor == xAnchor) && (rectangularBuild.xCaret == xCaret) &&
+			(rectangularBuild.virtualSpace == virtualSpace) &&
+			(rectangularBuild.layoutGeneration == llc.Generation()) &&
+			((linesBuilt == 1) || ((rectangularBuild.lineCaret > lineAnchorRect) == (lineCaret > lineAnchorRect)))) {
+			linesKept = Platform::Minimum(linesBuilt, abs(lineCaret - lineAnchorRect) + 1);
+			sel.TruncateRanges(linesKept);
+		}
+		for (int line=lineAnchorRect + linesKept * increment; line != lineCaret+increment; line += increment) {
 			SelectionRange range(SPositionFromLineX(line, xCaret), SPositionFromLineX(line, xAnchor));
-			if ((virtualSpaceOptions & SCVS_RECTANGULARSELECTION) == 0)
+			if (!virtualSpace)
 				range.ClearVirtualSpace();
 			if (line == lineAnchorRect)
 				sel.SetSelection(range);
 			else
 				sel.AddSelectionWithoutTrim(range);
 		}
+		sel.SetLinesOrdered(true);
+		rectangularBuild.lineAnchor = lineAnchorRect;
+		rectangularBuild.lineCaret = lineCaret;
+		rectangularBuild.xAnchor = xAnchor;
+		rectangularBuild.xCaret = xCaret;
+		rectangularBuild.virtualSpace = virtualSpace;
+		rectangularBuild.layoutGeneration = llc.Generation();
 	}
 }
 
@@ -746,12 +894,9 @@ void Editor::InvalidateSelection(SelectionRange newMain, bool invalidateWholeSel
 	int lastAffected = Platform::Maximum(newMain.caret.Position()+1, newMain.anchor.Position());
 	lastAffected = Platform::Maximum(lastAffected, sel.RangeMain().End().Position());
 	if (invalidateWholeSelection) {
-		for (size_t r=0; r<sel.Count(); r++) {
-			firstAffected = Platform::Minimum(firstAffected, sel.Range(r).caret.Position());
-			firstAffected = Platform::Minimum(firstAffected, sel.Range(r).anchor.Position());
-			lastAffected = Platform::Maximum(lastAffected, sel.Range(r).caret.Position()+1);
-			lastAffected = Platform::Maximum(lastAffected, sel.Range(r).anchor.Position());
-		}
+		SelectionSegment limits = sel.Limits();
+		firstAffected = Platform::Minimum(firstAffected, limits.start.Position());
+		lastAffected = Platform::Maximum(lastAffected, limits.end.Position()+1);
 	}
 	ContainerNeedsUpdate(SC_UPDATE_SELECTION);
 	InvalidateRange(firstAffected, lastAffected);
@@ -1419,6 +1564,10 @@ void Editor::DropCaret() {
 void Editor::InvalidateCaret() {
 	if (posDrag.IsValid()) {
 		InvalidateRange(posDrag.Position(), posDrag.Position() + 1);
+	} else if (sel.LinesOrdered()) {
+		// One area covers the carets of a rectangle
+		SelectionSegment limits = sel.Limits();
+		InvalidateRange(limits.start.Position(), limits.end.Position() + 1);
 	} else {
 		for (size_t r=0; r<sel.Count(); r++) {
 			InvalidateRange(sel.Range(r).caret.Position(), sel.Range(r).caret.Position() + 1);
@@ -1534,12 +1683,14 @@ bool Editor::WrapLines(bool fullWrap, int priorityWrapLineStart) {
 
 				// Platform::DebugPrintf("Wraplines: full = %d, priorityStart = %d (wrapping: %d to %d)\n", fullWrap, priorityWrapLineStart, lineToWrap, lastLineToWrap);
 				// Platform::DebugPrintf("Pending wraps: %d to %d\n", wrapStart, wrapEnd);
+				const int firstLineToWrap = lineToWrap;
 				while (lineToWrap < lastLineToWrap) {
 					if (WrapOneLine(surface, lineToWrap)) {
 						wrapOccurred = true;
 					}
 					lineToWrap++;
 				}
+				paintStatistics.Add(SC_PAINTSTAT_LINESWRAPPED, lineToWrap - firstLineToWrap);
 				if (!priorityWrap)
 					wrapStart = lineToWrap;
 				// If wrapping is done, bring it to resting position
@@ -1719,6 +1870,36 @@ void DrawStyledText(Surface *surface, ViewStyle &vs, int styleOffset, PRectangle
 	}
 }
 
+void Editor::FillMarginRow(Surface *surface, int margin, PRectangle rcRow) {
+	if (vs.ms[margin].style != SC_MARGIN_NUMBER) {
+		if (vs.ms[margin].mask & SC_MASK_FOLDERS) {
+			// Required because of special way brush is created for selection margin
+			// The pattern is tiled from the top of the row so use the shifted pattern
+			// on odd rows to match the pattern of neighbouring rows.
+			if (static_cast<int>(rcRow.top) % 2)
+				surface->FillRectangle(rcRow, *pixmapSelPatternOffset);
+			else
+				surface->FillRectangle(rcRow, *pixmapSelPattern);
+		} else {
+			ColourAllocated colour;
+			switch (vs.ms[margin].style) {
+			case SC_MARGIN_BACK:
+				colour = vs.styles[STYLE_DEFAULT].back.allocated;
+				break;
+			case SC_MARGIN_FORE:
+				colour = vs.styles[STYLE_DEFAULT].fore.allocated;
+				break;
+			default:
+				colour = vs.styles[STYLE_LINENUMBER].back.allocated;
+				break;
+			}
+			surface->FillRectangle(rcRow, colour);
+		}
+	} else {
+		surface->FillRectangle(rcRow, vs.styles[STYLE_LINENUMBER].back.allocated);
+	}
+}
+
 void Editor::PaintSelMargin(Surface *surfWindow, PRectangle &rc) {
 	if (vs.fixedColumnWidth == 0)
 		return;
@@ -1731,6 +1912,32 @@ void Editor::PaintSelMargin(Surface *surfWindow, PRectangle &rc) {
 
 	Surface *surface;
 	if (bufferedDraw) {
+		// Rows of the pixmap are only drawn again when what they show changes.
+		// After scrolling, move the rows that are still visible.
+		const int linesOnPixmap = rcMargin.Height() / vs.lineHeight + 1;
+		if (marginRows.Lines() != linesOnPixmap) {
+			marginRows.Allocate(linesOnPixmap, vs.margins);
+		} else if (marginRows.topLine != topLine) {
+			const int linesUp = topLine - marginRows.topLine;
+			if (abs(linesUp) < linesOnPixmap) {
+				PRectangle rcMoved = rcMargin;
+				Point ptFrom;
+				if (linesUp > 0) {
+					rcMoved.bottom -= linesUp * vs.lineHeight;
+					ptFrom.y = linesUp * vs.lineHeight;
+				} else {
+					rcMoved.top -= linesUp * vs.lineHeight;
+				}
+				pixmapSelMarginScroll->Copy(rcMoved, ptFrom, *pixmapSelMargin);
+				Surface *pixmapMoved = pixmapSelMarginScroll;
+				pixmapSelMarginScroll = pixmapSelMargin;
+				pixmapSelMargin = pixmapMoved;
+				marginRows.Scroll(linesUp);
+			} else {
+				marginRows.Invalidate();
+			}
+		}
+		marginRows.topLine = topLine;
 		surface = pixmapSelMargin;
 	} else {
 		surface = surfWindow;
@@ -1745,29 +1952,6 @@ void Editor::PaintSelMargin(Surface *surfWindow, PRectangle &rc) {
 			rcSelMargin.left = rcSelMargin.right;
 			rcSelMargin.right = rcSelMargin.left + vs.ms[margin].width;
 
-			if (vs.ms[margin].style != SC_MARGIN_NUMBER) {
-				if (vs.ms[margin].mask & SC_MASK_FOLDERS)
-					// Required because of special way brush is created for selection margin
-					surface->FillRectangle(rcSelMargin, *pixmapSelPattern);
-				else {
-					ColourAllocated colour;
-					switch (vs.ms[margin].style) {
-					case SC_MARGIN_BACK:
-						colour = vs.styles[STYLE_DEFAULT].back.allocated;
-						break;
-					case SC_MARGIN_FORE:
-						colour = vs.styles[STYLE_DEFAULT].fore.allocated;
-						break;
-					default:
-						colour = vs.styles[STYLE_LINENUMBER].back.allocated;
-						break;
-					}
-					surface->FillRectangle(rcSelMargin, colour);
-				}
-			} else {
-				surface->FillRectangle(rcSelMargin, vs.styles[STYLE_LINENUMBER].back.allocated);
-			}
-
 			int visibleLine = topLine;
 			int yposScreen = 0;
 			// Work out whether the top line is whitespace located after a
@@ -1800,9 +1984,24 @@ void Editor::PaintSelMargin(Surface *surfWindow, PRectangle &rc) {
 			int folderEnd = SubstituteMarkerIfEmpty(SC_MARKNUM_FOLDEREND,
 			        SC_MARKNUM_FOLDER);
 
-			while ((visibleLine < cs.LinesDisplayed()) && yposScreen < rcMargin.bottom) {
+			while (yposScreen < rcMargin.bottom) {
+
+				PRectangle rcMarker = rcSelMargin;
+				rcMarker.top = yposScreen;
+				rcMarker.bottom = yposScreen + vs.lineHeight;
+
+				if (visibleLine >= cs.LinesDisplayed()) {
+					// Past the end of the document
+					const MarginRow mrEmpty(-1, 0, 0, 0, 0);
+					if (!bufferedDraw || !marginRows.Matches(visibleLine - topLine, margin, mrEmpty)) {
+						FillMarginRow(surface, margin, rcMarker);
+						marginRows.Set(visibleLine - topLine, margin, mrEmpty);
+					}
+					visibleLine++;
+					yposScreen += vs.lineHeight;
+					continue;
+				}
 
-				PLATFORM_ASSERT(visibleLine < cs.LinesDisplayed());
 				int lineDoc = cs.DocFromDisplay(visibleLine);
 				PLATFORM_ASSERT(cs.GetVisible(lineDoc));
 				bool firstSubLine = visibleLine == cs.DisplayFromDoc(lineDoc);
@@ -1905,16 +2104,47 @@ void Editor::PaintSelMargin(Surface *surfWindow, PRectangle &rc) {
 
 				marks &= vs.ms[margin].mask;
 
-				PRectangle rcMarker = rcSelMargin;
-				rcMarker.top = yposScreen;
-				rcMarker.bottom = yposScreen + vs.lineHeight;
+				LineMarker::typeOfFold tFold = LineMarker::undefined;
+				if (marks && (vs.ms[margin].mask & SC_MASK_FOLDERS) && highlightDelimiter.IsFoldBlockHighlighted(lineDoc)) {
+					if (highlightDelimiter.IsBodyOfFoldBlock(lineDoc)) {
+						tFold = LineMarker::body;
+					} else if (highlightDelimiter.IsHeadOfFoldBlock(lineDoc)) {
+						if (firstSubLine) {
+							tFold = headWithTail ? LineMarker::headWithTail : LineMarker::head;
+						} else {
+							if (cs.GetExpanded(lineDoc) || headWithTail) {
+								tFold = LineMarker::body;
+							} else {
+								tFold = LineMarker::undefined;
+							}
+						}
+					} else if (highlightDelimiter.IsTailOfFoldBlock(lineDoc)) {
+						tFold = LineMarker::tail;
+					}
+				}
+
+				int levelShown = 0;
+				if ((vs.ms[margin].style == SC_MARGIN_NUMBER) && (foldFlags & SC_FOLDFLAG_LEVELNUMBERS))
+					levelShown = pdoc->GetLevel(lineDoc);
+
+				const MarginRow mr(lineDoc, visibleLine - cs.DisplayFromDoc(lineDoc), marks, tFold, levelShown);
+				if (bufferedDraw && marginRows.Matches(visibleLine - topLine, margin, mr)) {
+					// Row in pixmap already shows this
+					visibleLine++;
+					yposScreen += vs.lineHeight;
+					continue;
+				}
+				marginRows.Set(visibleLine - topLine, margin, mr);
+
+				FillMarginRow(surface, margin, rcMarker);
+
 				if (vs.ms[margin].style == SC_MARGIN_NUMBER) {
 					char number[100];
 					number[0] = '\0';
 					if (firstSubLine)
 						sprintf(number, "%d", lineDoc + 1);
 					if (foldFlags & SC_FOLDFLAG_LEVELNUMBERS) {
-						int lev = pdoc->GetLevel(lineDoc);
+						int lev = levelShown;
 						sprintf(number, "%c%c %03X %03X",
 						        (lev & SC_FOLDLEVELHEADERFLAG) ? 'H' : '_',
 						        (lev & SC_FOLDLEVELWHITEFLAG) ? 'W' : '_',
@@ -1950,24 +2180,6 @@ void Editor::PaintSelMargin(Surface *surfWindow, PRectangle &rc) {
 				if (marks) {
 					for (int markBit = 0; (markBit < 32) && marks; markBit++) {
 						if (marks & 1) {
-							LineMarker::typeOfFold tFold = LineMarker::undefined;
-							if ((vs.ms[margin].mask & SC_MASK_FOLDERS) && highlightDelimiter.IsFoldBlockHighlighted(lineDoc)) {
-								if (highlightDelimiter.IsBodyOfFoldBlock(lineDoc)) {
-									tFold = LineMarker::body;
-								} else if (highlightDelimiter.IsHeadOfFoldBlock(lineDoc)) {
-									if (firstSubLine) {
-										tFold = headWithTail ? LineMarker::headWithTail : LineMarker::head;
-									} else {
-										if (cs.GetExpanded(lineDoc) || headWithTail) {
-											tFold = LineMarker::body;
-										} else {
-											tFold = LineMarker::undefined;
-										}
-									}
-								} else if (highlightDelimiter.IsTailOfFoldBlock(lineDoc)) {
-									tFold = LineMarker::tail;
-								}
-							}
 							vs.markers[markBit].Draw(surface, rcMarker, vs.styles[STYLE_LINENUMBER].font, tFold);
 						}
 						marks >>= 1;
@@ -2011,8 +2223,13 @@ LineLayout *Editor::RetrieveLineLayout(int lineNumber) {
 	int posLineEnd = pdoc->LineStart(lineNumber + 1);
 	PLATFORM_ASSERT(posLineEnd >= posLineStart);
 	int lineCaret = pdoc->LineFromPosition(sel.MainCaret());
+	int maxChars = posLineEnd - posLineStart;
+	if ((wrapState == eWrapNone) && (maxChars > LineLayout::lengthStartWindow)) {
+		// Very long lines are laid out in windows which grow the layout when needed
+		maxChars = LineCheckpoints::checkpointInterval;
+	}
 	return llc.Retrieve(lineNumber, lineCaret,
-	        posLineEnd - posLineStart, pdoc->GetStyleClock(),
+	        maxChars, pdoc->GetStyleClock(),
 	        LinesOnScreen() + 1, pdoc->LinesTotal());
 }
 
@@ -2105,19 +2322,150 @@ bool BadUTF(const char *s, int len, int &trailBytes) {
 	}
 }
 
+/**
+ * See if the layout of @a ll still matches the document text and styles starting at @a position.
+ */
+bool Editor::LayoutMatchesDocument(ViewStyle &vstyle, LineLayout *ll, int position) {
+	// See if chars, styles, indicators, are all the same
+	bool allSame = true;
+	const int styleMask = pdoc->stylingBitsMask;
+	// Check base line layout
+	char styleByte = 0;
+	int numCharsInLine = 0;
+	while (numCharsInLine < ll->numCharsInLine) {
+		int charInDoc = numCharsInLine + position;
+		char chDoc = pdoc->CharAt(charInDoc);
+		styleByte = pdoc->StyleAt(charInDoc);
+		allSame = allSame &&
+		        (ll->styles[numCharsInLine] == static_cast<unsigned char>(styleByte & styleMask));
+		allSame = allSame &&
+		        (ll->indicators[numCharsInLine] == static_cast<char>(styleByte & ~styleMask));
+		if (vstyle.styles[ll->styles[numCharsInLine]].caseForce == Style::caseMixed)
+			allSame = allSame &&
+			        (ll->chars[numCharsInLine] == chDoc);
+		else if (vstyle.styles[ll->styles[numCharsInLine]].caseForce == Style::caseLower)
+			allSame = allSame &&
+			        (ll->chars[numCharsInLine] == static_cast<char>(tolower(chDoc)));
+		else	// Style::caseUpper
+			allSame = allSame &&
+			        (ll->chars[numCharsInLine] == static_cast<char>(toupper(chDoc)));
+		numCharsInLine++;
+	}
+	allSame = allSame && (ll->styles[numCharsInLine] == styleByte);	// For eolFilled
+	return allSame;
+}
+
+/**
+ * Determine the x position of each character in @a ll from @a start up to @a end.
+ * @a xStart is the distance of @a start from the beginning of the document line
+ * so that tabs line up with the tab stops of the whole line.
+ * Positions are relative to the beginning of the document line.
+ * @return true if the last segment is in an italic style.
+ */
+bool Editor::MeasureSegments(Surface *surface, ViewStyle &vstyle, LineLayout *ll, int start, int end, int xStart) {
+	PaintStatisticTimer ptMeasure(paintStatistics, SC_PAINTSTAT_MEASURETIME);
+	int startseg = start;	// Start of the current segment, in char. number
+	int startsegx = xStart;	// Start of the current segment, in pixels
+	ll->positions[start] = xStart;
+	unsigned int tabWidth = vstyle.spaceWidth * pdoc->tabInChars;
+	bool lastSegItalics = false;
+	Font &ctrlCharsFont = vstyle.styles[STYLE_CONTROLCHAR].font;
+
+	int ctrlCharWidth[32] = {0};
+	bool isControlNext = IsControlCharacter(ll->chars[start]);
+	int trailBytes = 0;
+	bool isBadUTFNext = IsUnicodeMode() && BadUTF(ll->chars + start, end - start, trailBytes);
+	for (int charInLine = start; charInLine < end; charInLine++) {
+		bool isControl = isControlNext;
+		isControlNext = IsControlCharacter(ll->chars[charInLine + 1]);
+		bool isBadUTF = isBadUTFNext;
+		isBadUTFNext = IsUnicodeMode() && BadUTF(ll->chars + charInLine + 1, end - charInLine - 1, trailBytes);
+		if ((ll->styles[charInLine] != ll->styles[charInLine + 1]) ||
+		        isControl || isControlNext || isBadUTF || isBadUTFNext || (charInLine + 1 == end)) {
+			ll->positions[startseg] = 0;
+			if (vstyle.styles[ll->styles[charInLine]].visible) {
+				if (isControl) {
+					if (ll->chars[charInLine] == '\t') {
+						ll->positions[charInLine + 1] = ((((startsegx + 2) /
+						        tabWidth) + 1) * tabWidth) - startsegx;
+					} else if (controlCharSymbol < 32) {
+						if (ctrlCharWidth[ll->chars[charInLine]] == 0) {
+							const char *ctrlChar = ControlCharacterString(ll->chars[charInLine]);
+							// +3 For a blank on front and rounded edge each side:
+							ctrlCharWidth[ll->chars[charInLine]] =
+							    surface->WidthText(ctrlCharsFont, ctrlChar, istrlen(ctrlChar)) + 3;
+						}
+						ll->positions[charInLine + 1] = ctrlCharWidth[ll->chars[charInLine]];
+					} else {
+						char cc[2] = { static_cast<char>(controlCharSymbol), '\0' };
+						surface->MeasureWidths(ctrlCharsFont, cc, 1,
+						        ll->positions + startseg + 1);
+					}
+					lastSegItalics = false;
+				} else if (isBadUTF) {
+					char hexits[4];
+					sprintf(hexits, "x%2X", ll->chars[charInLine] & 0xff);
+					ll->positions[charInLine + 1] =
+					    surface->WidthText(ctrlCharsFont, hexits, istrlen(hexits)) + 3;
+				} else {	// Regular character
+					int lenSeg = charInLine - startseg + 1;
+					if ((lenSeg == 1) && (' ' == ll->chars[startseg])) {
+						lastSegItalics = false;
+						// Over half the segments are single characters and of these about half are space characters.
+						ll->positions[charInLine + 1] = vstyle.styles[ll->styles[charInLine]].spaceWidth;
+					} else {
+						lastSegItalics = vstyle.styles[ll->styles[charInLine]].italic;
+						posCache.MeasureWidths(surface, vstyle, ll->styles[charInLine], ll->chars + startseg,
+						        lenSeg, ll->positions + startseg + 1, pdoc);
+					}
+				}
+			} else {    // invisible
+				for (int posToZero = startseg; posToZero <= (charInLine + 1); posToZero++) {
+					ll->positions[posToZero] = 0;
+				}
+			}
+			for (int posToIncrease = startseg; posToIncrease <= (charInLine + 1); posToIncrease++) {
+				ll->positions[posToIncrease] += startsegx;
+			}
+			startsegx = ll->positions[charInLine + 1];
+			startseg = charInLine + 1;
+		}
+	}
+	return lastSegItalics;
+}
+
 /**
  * Fill in the LineLayout data for the given line.
  * Copy the given @a line and its styles from the document into local arrays.
  * Also determine the x position at which each character starts.
+ * Very long unwrapped lines are only laid out around the view, or around
+ * @a posTarget or @a xTarget when they are not -1.
  */
-void Editor::LayoutLine(int line, Surface *surface, ViewStyle &vstyle, LineLayout *ll, int width) {
+void Editor::LayoutLine(int line, Surface *surface, ViewStyle &vstyle, LineLayout *ll, int width,
+        int posTarget, int xTarget) {
 	if (!ll)
 		return;
 
+	PaintStatisticTimer ptLayout(paintStatistics, SC_PAINTSTAT_LAYOUTTIME);
 	PLATFORM_ASSERT(line < pdoc->LinesTotal());
 	PLATFORM_ASSERT(ll->chars != NULL);
 	int posLineStart = pdoc->LineStart(line);
 	int posLineEnd = pdoc->LineStart(line + 1);
+	// Checkpoints are measured with the view's styles so printing always lays out whole lines
+	if ((width == LineLayout::wrapWidthInfinite) && (&vstyle == &vs) &&
+	        (posLineEnd - posLineStart > LineLayout::lengthStartWindow)) {
+		LayoutLineWindow(line, surface, vstyle, ll, posTarget, xTarget);
+		return;
+	}
+	if (ll->windowed) {
+		ll->ClearWindow();
+		ll->validity = LineLayout::llInvalid;
+	}
+	if ((&vstyle == &vs) && (posLineEnd - posLineStart > ll->maxLineLength)) {
+		// Retrieved at window size for an unwrapped line but now needed whole
+		ll->Resize(posLineEnd - posLineStart);
+		ll->validity = LineLayout::llInvalid;
+	}
 	// If the line is very long, limit the treatment to a length that should fit in the viewport
 	if (posLineEnd > (posLineStart + ll->maxLineLength)) {
 		posLineEnd = posLineStart + ll->maxLineLength;
@@ -2131,42 +2479,14 @@ void Editor::LayoutLine(int line, Surface *surface, ViewStyle &vstyle, LineLayou
 				lineLength--;
 			}
 		}
-		if (lineLength == ll->numCharsInLine) {
-			// See if chars, styles, indicators, are all the same
-			bool allSame = true;
-			const int styleMask = pdoc->stylingBitsMask;
-			// Check base line layout
-			char styleByte = 0;
-			int numCharsInLine = 0;
-			while (numCharsInLine < lineLength) {
-				int charInDoc = numCharsInLine + posLineStart;
-				char chDoc = pdoc->CharAt(charInDoc);
-				styleByte = pdoc->StyleAt(charInDoc);
-				allSame = allSame &&
-				        (ll->styles[numCharsInLine] == static_cast<unsigned char>(styleByte & styleMask));
-				allSame = allSame &&
-				        (ll->indicators[numCharsInLine] == static_cast<char>(styleByte & ~styleMask));
-				if (vstyle.styles[ll->styles[numCharsInLine]].caseForce == Style::caseMixed)
-					allSame = allSame &&
-					        (ll->chars[numCharsInLine] == chDoc);
-				else if (vstyle.styles[ll->styles[numCharsInLine]].caseForce == Style::caseLower)
-					allSame = allSame &&
-					        (ll->chars[numCharsInLine] == static_cast<char>(tolower(chDoc)));
-				else	// Style::caseUpper
-					allSame = allSame &&
-					        (ll->chars[numCharsInLine] == static_cast<char>(toupper(chDoc)));
-				numCharsInLine++;
-			}
-			allSame = allSame && (ll->styles[numCharsInLine] == styleByte);	// For eolFilled
-			if (allSame) {
-				ll->validity = LineLayout::llPositions;
-			} else {
-				ll->validity = LineLayout::llInvalid;
-			}
+		if ((lineLength == ll->numCharsInLine) && LayoutMatchesDocument(vstyle, ll, posLineStart)) {
+			ll->validity = LineLayout::llPositions;
 		} else {
 			ll->validity = LineLayout::llInvalid;
 		}
 	}
+	paintStatistics.Add((ll->validity == LineLayout::llInvalid) ?
+		SC_PAINTSTAT_LINESLAIDOUT : SC_PAINTSTAT_LAYOUTCACHEHITS, 1);
 	if (ll->validity == LineLayout::llInvalid) {
 		ll->widthLine = LineLayout::wrapWidthInfinite;
 		ll->lines = 1;
@@ -2215,76 +2535,10 @@ void Editor::LayoutLine(int line, Surface *surface, ViewStyle &vstyle, LineLayou
 
 		// Layout the line, determining the position of each character,
 		// with an extra element at the end for the end of the line.
-		int startseg = 0;	// Start of the current segment, in char. number
-		int startsegx = 0;	// Start of the current segment, in pixels
-		ll->positions[0] = 0;
-		unsigned int tabWidth = vstyle.spaceWidth * pdoc->tabInChars;
-		bool lastSegItalics = false;
-		Font &ctrlCharsFont = vstyle.styles[STYLE_CONTROLCHAR].font;
-
-		int ctrlCharWidth[32] = {0};
-		bool isControlNext = IsControlCharacter(ll->chars[0]);
-		int trailBytes = 0;
-		bool isBadUTFNext = IsUnicodeMode() && BadUTF(ll->chars, numCharsInLine, trailBytes);
-		for (int charInLine = 0; charInLine < numCharsInLine; charInLine++) {
-			bool isControl = isControlNext;
-			isControlNext = IsControlCharacter(ll->chars[charInLine + 1]);
-			bool isBadUTF = isBadUTFNext;
-			isBadUTFNext = IsUnicodeMode() && BadUTF(ll->chars + charInLine + 1, numCharsInLine - charInLine - 1, trailBytes);
-			if ((ll->styles[charInLine] != ll->styles[charInLine + 1]) ||
-			        isControl || isControlNext || isBadUTF || isBadUTFNext) {
-				ll->positions[startseg] = 0;
-				if (vstyle.styles[ll->styles[charInLine]].visible) {
-					if (isControl) {
-						if (ll->chars[charInLine] == '\t') {
-							ll->positions[charInLine + 1] = ((((startsegx + 2) /
-							        tabWidth) + 1) * tabWidth) - startsegx;
-						} else if (controlCharSymbol < 32) {
-							if (ctrlCharWidth[ll->chars[charInLine]] == 0) {
-								const char *ctrlChar = ControlCharacterString(ll->chars[charInLine]);
-								// +3 For a blank on front and rounded edge each side:
-								ctrlCharWidth[ll->chars[charInLine]] =
-								    surface->WidthText(ctrlCharsFont, ctrlChar, istrlen(ctrlChar)) + 3;
-							}
-							ll->positions[charInLine + 1] = ctrlCharWidth[ll->chars[charInLine]];
-						} else {
-							char cc[2] = { static_cast<char>(controlCharSymbol), '\0' };
-							surface->MeasureWidths(ctrlCharsFont, cc, 1,
-							        ll->positions + startseg + 1);
-						}
-						lastSegItalics = false;
-					} else if (isBadUTF) {
-						char hexits[4];
-						sprintf(hexits, "x%2X", ll->chars[charInLine] & 0xff);
-						ll->positions[charInLine + 1] =
-						    surface->WidthText(ctrlCharsFont, hexits, istrlen(hexits)) + 3;
-					} else {	// Regular character
-						int lenSeg = charInLine - startseg + 1;
-						if ((lenSeg == 1) && (' ' == ll->chars[startseg])) {
-							lastSegItalics = false;
-							// Over half the segments are single characters and of these about half are space characters.
-							ll->positions[charInLine + 1] = vstyle.styles[ll->styles[charInLine]].spaceWidth;
-						} else {
-							lastSegItalics = vstyle.styles[ll->styles[charInLine]].italic;
-							posCache.MeasureWidths(surface, vstyle, ll->styles[charInLine], ll->chars + startseg,
-							        lenSeg, ll->positions + startseg + 1, pdoc);
-						}
-					}
-				} else {    // invisible
-					for (int posToZero = startseg; posToZero <= (charInLine + 1); posToZero++) {
-						ll->positions[posToZero] = 0;
-					}
-				}
-				for (int posToIncrease = startseg; posToIncrease <= (charInLine + 1); posToIncrease++) {
-					ll->positions[posToIncrease] += startsegx;
-				}
-				startsegx = ll->positions[charInLine + 1];
-				startseg = charInLine + 1;
-			}
-		}
+		bool lastSegItalics = MeasureSegments(surface, vstyle, ll, 0, numCharsInLine, 0);
 		// Small hack to make lines that end with italics not cut off the edge of the last character
-		if ((startseg > 0) && lastSegItalics) {
-			ll->positions[startseg] += 2;
+		if ((numCharsInLine > 0) && lastSegItalics) {
+			ll->positions[numCharsInLine] += 2;
 		}
 		ll->numCharsInLine = numCharsInLine;
 		ll->numCharsBeforeEOL = numCharsBeforeEOL;
@@ -2368,6 +2622,154 @@ void Editor::LayoutLine(int line, Surface *surface, ViewStyle &vstyle, LineLayou
 	}
 }
 
+/**
+ * Measure the next interval of a very long line and add a checkpoint at its end.
+ * The layout arrays of @a ll are used as scratch space.
+ * @return false if the remainder of the line is shorter than an interval.
+ */
+bool Editor::AddLineCheckpoint(Surface *surface, ViewStyle &vstyle, LineLayout *ll,
+        LineCheckpoints *lcp, int posLineStart, int lengthLayout) {
+	const int start = lcp->Position(lcp->len - 1);
+	int end = start + LineCheckpoints::checkpointInterval;
+	if (end >= lengthLayout)
+		return false;
+	end = pdoc->MovePositionOutsideChar(posLineStart + end, 1, false) - posLineStart;
+	if (end >= lengthLayout)
+		return false;
+	const int lengthChunk = end - start;
+	ll->Resize(lengthChunk);
+	ll->validity = LineLayout::llInvalid;
+	LayoutFill(vstyle, ll, posLineStart + start, lengthChunk);
+	MeasureSegments(surface, vstyle, ll, 0, lengthChunk, lcp->X(lcp->len - 1));
+	lcp->Add(end, ll->positions[lengthChunk]);
+	return true;
+}
+
+/**
+ * Copy text and styles of a range of the document into the start of the layout arrays
+ * with a terminating element after them.
+ */
+void Editor::LayoutFill(ViewStyle &vstyle, LineLayout *ll, int position, int length) {
+	const int styleMask = pdoc->stylingBitsMask;
+	pdoc->GetCharRange(ll->chars, position, length);
+	pdoc->GetStyleRange(ll->styles, position, length);
+	for (int i = 0; i < length; i++) {
+		char styleByte = ll->styles[i];
+		ll->styleBitsSet |= styleByte;
+		ll->styles[i] = static_cast<char>(styleByte & styleMask);
+		ll->indicators[i] = static_cast<char>(styleByte & ~styleMask);
+		if (vstyle.someStylesForceCase) {
+			if (vstyle.styles[ll->styles[i]].caseForce == Style::caseUpper)
+				ll->chars[i] = static_cast<char>(toupper(ll->chars[i]));
+			else if (vstyle.styles[ll->styles[i]].caseForce == Style::caseLower)
+				ll->chars[i] = static_cast<char>(tolower(ll->chars[i]));
+		}
+	}
+	ll->chars[length] = 0;
+	ll->styles[length] = (length > 0) ? ll->styles[length - 1] : 0;
+	ll->indicators[length] = 0;
+}
+
+/**
+ * Lay out only a window of a very long unwrapped line. The window starts at a checkpoint
+ * and covers the view horizontally, or @a posTarget or @a xTarget when they are not -1,
+ * with an extra interval either side.
+ * Checkpoints are only measured up to the end of the window so the rest of the line costs nothing.
+ */
+void Editor::LayoutLineWindow(int line, Surface *surface, ViewStyle &vstyle, LineLayout *ll,
+        int posTarget, int xTarget) {
+	const int posLineStart = pdoc->LineStart(line);
+	const int lengthBeforeEOL = pdoc->LineEnd(line) - posLineStart;
+	const int lengthLayout = vstyle.viewEOL ? (pdoc->LineStart(line + 1) - posLineStart) : lengthBeforeEOL;
+
+	LineCheckpoints *lcp = llc.RetrieveCheckpoints(line);
+	if (lcp->len == 0)
+		lcp->Add(0, 0);
+
+	int xLeft = xOffset;
+	int xRight = xOffset + GetTextRectangle().Width();
+	if (xTarget >= 0) {
+		xLeft = xTarget;
+		xRight = xTarget;
+	}
+
+	// See if the current window is still valid and contains the target
+	if (ll->windowed && (ll->validity != LineLayout::llInvalid)) {
+		const int windowEnd = ll->windowStart + ll->numCharsInLine;
+		const int cpStart = lcp->FindPosition(ll->windowStart);
+		const int cpEnd = lcp->FindPosition(windowEnd);
+		bool valid = (lcp->Position(cpStart) == ll->windowStart) && (lcp->X(cpStart) == ll->xWindowStart) &&
+		        ((windowEnd == lengthLayout) || (lcp->Position(cpEnd) == windowEnd));
+		if (valid && (ll->validity == LineLayout::llCheckTextAndStyle)) {
+			valid = LayoutMatchesDocument(vstyle, ll, posLineStart + ll->windowStart);
+		}
+		if (valid) {
+			if (posTarget >= 0) {
+				valid = (posTarget >= ll->windowStart) && (posTarget <= windowEnd);
+			} else {
+				valid = ((ll->windowStart == 0) || (xLeft >= ll->xWindowStart)) &&
+				        ((windowEnd == lengthLayout) || (xRight < ll->xWindowStart + ll->positions[ll->numCharsInLine]));
+			}
+		}
+		if (valid) {
+			ll->validity = LineLayout::llLines;
+			paintStatistics.Add(SC_PAINTSTAT_LAYOUTCACHEHITS, 1);
+			return;
+		}
+	}
+	paintStatistics.Add(SC_PAINTSTAT_LINESLAIDOUT, 1);
+
+	// Measure checkpoints up to an interval past the target
+	for (;;) {
+		const int cpTarget = (posTarget >= 0) ? lcp->FindPosition(posTarget) : lcp->FindX(xRight);
+		if ((lcp->len - 1 >= cpTarget + 2) ||
+		        !AddLineCheckpoint(surface, vstyle, ll, lcp, posLineStart, lengthLayout))
+			break;
+	}
+	int cpFirst = (posTarget >= 0) ? lcp->FindPosition(posTarget) : lcp->FindX(xLeft);
+	int cpLast = ((posTarget >= 0) ? lcp->FindPosition(posTarget) : lcp->FindX(xRight)) + 2;
+	if (cpFirst > 0)
+		cpFirst--;
+	const int windowStart = lcp->Position(cpFirst);
+	const int windowEnd = (cpLast < lcp->len) ? lcp->Position(cpLast) : lengthLayout;
+	const int numCharsInLine = windowEnd - windowStart;
+
+	ll->Resize(numCharsInLine);
+	ll->SetWindow(windowStart, lcp->X(cpFirst));
+	ll->widthLine = LineLayout::wrapWidthInfinite;
+	ll->lines = 1;
+	ll->xHighlightGuide = 0;
+	if (vstyle.edgeState == EDGE_BACKGROUND) {
+		ll->edgeColumn = pdoc->FindColumn(line, theEdge) - posLineStart - windowStart;
+	} else {
+		ll->edgeColumn = -1;
+	}
+	ll->styleBitsSet = 0;
+	LayoutFill(vstyle, ll, posLineStart + windowStart, numCharsInLine);
+
+	// Measure each interval separately so positions match the checkpoints exactly
+	bool lastSegItalics = false;
+	int cp = cpFirst;
+	int start = 0;
+	ll->positions[0] = ll->xWindowStart;
+	while (start < numCharsInLine) {
+		cp++;
+		const int end = ((cp < lcp->len) && (lcp->Position(cp) < windowEnd)) ?
+		        lcp->Position(cp) - windowStart : numCharsInLine;
+		lastSegItalics = MeasureSegments(surface, vstyle, ll, start, end, ll->positions[start]);
+		start = end;
+	}
+	for (int i = 0; i <= numCharsInLine; i++) {
+		ll->positions[i] -= ll->xWindowStart;
+	}
+	if ((windowEnd == lengthLayout) && (numCharsInLine > 0) && lastSegItalics) {
+		ll->positions[numCharsInLine] += 2;
+	}
+	ll->numCharsInLine = numCharsInLine;
+	ll->numCharsBeforeEOL = Platform::Minimum(windowEnd, lengthBeforeEOL) - windowStart;
+	ll->validity = LineLayout::llLines;
+}
+
 ColourAllocated Editor::SelectionBackground(ViewStyle &vsDraw, bool main) {
 	return main ?
 		(primarySelection ? vsDraw.selbackground.allocated : vsDraw.selbackground2.allocated) :
@@ -2487,13 +2889,13 @@ void Editor::DrawEOL(Surface *surface, ViewStyle &vsDraw, PRectangle rcLine, Lin
         bool overrideBackground, ColourAllocated background,
         bool drawWrapMarkEnd, ColourAllocated wrapColour) {
 
-	const int posLineStart = pdoc->LineStart(line);
+	const int posLineStart = pdoc->LineStart(line) + ll->windowStart;
 	const int styleMask = pdoc->stylingBitsMask;
 	PRectangle rcSegment = rcLine;
 
 	const bool lastSubLine = subLine == (ll->lines - 1);
 	int virtualSpace = 0;
-	if (lastSubLine) {
+	if (lastSubLine && (posLineStart + ll->numCharsBeforeEOL == pdoc->LineEnd(line))) {
 		const int spaceWidth = static_cast<int>(vsDraw.styles[ll->EndLineStyle()].spaceWidth);
 		virtualSpace = sel.VirtualSpaceFor(pdoc->LineEnd(line)) * spaceWidth;
 	}
@@ -2509,7 +2911,10 @@ void Editor::DrawEOL(Surface *surface, ViewStyle &vsDraw, PRectangle rcLine, Lin
 		surface->FillRectangle(rcSegment, overrideBackground ? background : vsDraw.styles[ll->styles[ll->numCharsInLine] & styleMask].back.allocated);
 		if (!hideSelection && ((vsDraw.selAlpha == SC_ALPHA_NOALPHA) || (vsDraw.selAdditionalAlpha == SC_ALPHA_NOALPHA))) {
 			SelectionSegment virtualSpaceRange(SelectionPosition(pdoc->LineEnd(line)), SelectionPosition(pdoc->LineEnd(line), sel.VirtualSpaceFor(pdoc->LineEnd(line))));
-			for (size_t r=0; r<sel.Count(); r++) {
+			size_t rangeFirst;
+			size_t rangeLast;
+			sel.RangesNear(pdoc->LineEnd(line), pdoc->LineEnd(line), rangeFirst, rangeLast);
+			for (size_t r=rangeFirst; r<rangeLast; r++) {
 				int alpha = (r == sel.Main()) ? vsDraw.selAlpha : vsDraw.selAdditionalAlpha;
 				if (alpha == SC_ALPHA_NOALPHA) {
 					SelectionSegment portion = sel.Range(r).Intersect(virtualSpaceRange);
@@ -2616,7 +3021,7 @@ void Editor::DrawEOL(Surface *surface, ViewStyle &vsDraw, PRectangle rcLine, Lin
 
 void Editor::DrawIndicator(int indicNum, int startPos, int endPos, Surface *surface, ViewStyle &vsDraw,
 		int xStart, PRectangle rcLine, LineLayout *ll, int subLine) {
-	const int subLineStart = ll->positions[ll->LineStart(subLine)];
+	const int subLineStart = ll->SubLineStart(subLine);
 	PRectangle rcIndic(
 		ll->positions[startPos] + xStart - subLineStart,
 		rcLine.top + vsDraw.maxAscent,
@@ -2628,7 +3033,7 @@ void Editor::DrawIndicator(int indicNum, int startPos, int endPos, Surface *surf
 void Editor::DrawIndicators(Surface *surface, ViewStyle &vsDraw, int line, int xStart,
         PRectangle rcLine, LineLayout *ll, int subLine, int lineEnd, bool under) {
 	// Draw decorators
-	const int posLineStart = pdoc->LineStart(line);
+	const int posLineStart = pdoc->LineStart(line) + ll->windowStart;
 	const int lineStart = ll->LineStart(subLine);
 	const int posLineEnd = posLineStart + lineEnd;
 
@@ -2807,13 +3212,14 @@ void Editor::DrawLine(Surface *surface, ViewStyle &vsDraw, int line, int lineVis
 	bool drawWhitespaceBackground = (vsDraw.viewWhitespace != wsInvisible) &&
 	        (!overrideBackground) && (vsDraw.whitespaceBackgroundSet);
 
-	bool inIndentation = subLine == 0;	// Do not handle indentation except on first subline.
+	// Do not handle indentation except on first subline or in a window past the line start.
+	bool inIndentation = (subLine == 0) && (ll->windowStart == 0);
 	int indentWidth = pdoc->IndentSize() * vsDraw.spaceWidth;
 
-	int posLineStart = pdoc->LineStart(line);
+	int posLineStart = pdoc->LineStart(line) + ll->windowStart;
 
 	int startseg = ll->LineStart(subLine);
-	int subLineStart = ll->positions[startseg];
+	int subLineStart = ll->SubLineStart(subLine);
 	if (subLine >= ll->lines) {
 		DrawAnnotation(surface, vsDraw, line, xStart, rcLine, ll, subLine);
 		return; // No further drawing
@@ -2975,7 +3381,7 @@ void Editor::DrawLine(Surface *surface, ViewStyle &vsDraw, int line, int lineVis
 		marks >>= 1;
 	}
 
-	inIndentation = subLine == 0;	// Do not handle indentation except on first subline.
+	inIndentation = (subLine == 0) && (ll->windowStart == 0);
 	// Foreground drawing loop
 	BreakFinder bfFore(ll, lineStart, lineEnd, posLineStart, xStartVisible,
 		((!twoPhaseDraw && selBackDrawn) || vsDraw.selforeset), pdoc);
@@ -3126,7 +3532,8 @@ void Editor::DrawLine(Surface *surface, ViewStyle &vsDraw, int line, int lineVis
 	if ((vsDraw.viewIndentationGuides == ivLookForward || vsDraw.viewIndentationGuides == ivLookBoth)
 	        && (subLine == 0)) {
 		int indentSpace = pdoc->GetLineIndentation(line);
-		int xStartText = ll->positions[pdoc->GetLineIndentPosition(line) - posLineStart];
+		int xStartText = ll->positions[Platform::Clamp(pdoc->GetLineIndentPosition(line) - posLineStart,
+			0, ll->numCharsInLine)] + ll->xWindowStart;
 
 		// Find the most recent line with some text
 
@@ -3190,7 +3597,10 @@ void Editor::DrawLine(Surface *surface, ViewStyle &vsDraw, int line, int lineVis
 		SelectionPosition posStart(posLineStart);
 		SelectionPosition posEnd(posLineStart + lineEnd, virtualSpaces);
 		SelectionSegment virtualSpaceRange(posStart, posEnd);
-		for (size_t r=0; r<sel.Count(); r++) {
+		size_t rangeFirst;
+		size_t rangeLast;
+		sel.RangesNear(posLineStart, posLineStart + lineEnd, rangeFirst, rangeLast);
+		for (size_t r=rangeFirst; r<rangeLast; r++) {
 			int alpha = (r == sel.Main()) ? vsDraw.selAlpha : vsDraw.selAdditionalAlpha;
 			if (alpha != SC_ALPHA_NOALPHA) {
 				SelectionSegment portion = sel.Range(r).Intersect(virtualSpaceRange);
@@ -3280,8 +3690,8 @@ void Editor::DrawBlockCaret(Surface *surface, ViewStyle &vsDraw, LineLayout *ll,
 	}
 
 	// We now know what to draw, update the caret drawing rectangle
-	rcCaret.left = ll->positions[offsetFirstChar] - ll->positions[lineStart] + xStart;
-	rcCaret.right = ll->positions[offsetFirstChar+numCharsToDraw] - ll->positions[lineStart] + xStart;
+	rcCaret.left = ll->positions[offsetFirstChar] - ll->SubLineStart(subLine) + xStart;
+	rcCaret.right = ll->positions[offsetFirstChar+numCharsToDraw] - ll->SubLineStart(subLine) + xStart;
 
 	// Adjust caret position to take into account any word wrapping symbols.
 	if ((ll->wrapIndent != 0) && (lineStart != 0)) {
@@ -3335,6 +3745,17 @@ void Editor::RefreshPixMaps(Surface *surfaceWindow) {
 				pixmapSelPattern->FillRectangle(rcPixel, colourFMStripes);
 			}
 		}
+
+		// Margin rows are filled separately so a pattern shifted by one pixel is used when
+		// a row starts on an odd pixel to keep the checkerboard continuous.
+		pixmapSelPatternOffset->InitPixMap(patternSize, patternSize, surfaceWindow, wMain.GetID());
+		pixmapSelPatternOffset->FillRectangle(rcPattern, colourFMFill);
+		for (int y = 0; y < patternSize; y++) {
+			for (int x = (y + 1) % 2; x < patternSize; x+=2) {
+				PRectangle rcPixel(x, y, x+1, y+1);
+				pixmapSelPatternOffset->FillRectangle(rcPixel, colourFMStripes);
+			}
+		}
 	}
 
 	if (!pixmapIndentGuide->Initialised()) {
@@ -3360,6 +3781,9 @@ void Editor::RefreshPixMaps(Surface *surfaceWindow) {
 			        surfaceWindow, wMain.GetID());
 			pixmapSelMargin->InitPixMap(vs.fixedColumnWidth,
 			        rcClient.Height(), surfaceWindow, wMain.GetID());
+			pixmapSelMarginScroll->InitPixMap(vs.fixedColumnWidth,
+			        rcClient.Height(), surfaceWindow, wMain.GetID());
+			marginRows.Invalidate();
 		}
 	}
 }
@@ -3370,16 +3794,20 @@ void Editor::DrawCarets(Surface *surface, ViewStyle &vsDraw, int lineDoc, int xS
 	bool drawDrag = posDrag.IsValid();
 	if (hideSelection && !drawDrag)
 		return;
-	const int posLineStart = pdoc->LineStart(lineDoc);
+	const int posLineStart = pdoc->LineStart(lineDoc) + ll->windowStart;
+	size_t rangeFirst = 0;
+	size_t rangeLast = sel.Count();
+	if (!drawDrag)
+		sel.RangesNear(posLineStart, posLineStart + ll->numCharsInLine, rangeFirst, rangeLast);
 	// For each selection draw
-	for (size_t r=0; (r<sel.Count()) || drawDrag; r++) {
+	for (size_t r=rangeFirst; (r<rangeLast) || drawDrag; r++) {
 		const bool mainCaret = r == sel.Main();
 		const SelectionPosition posCaret = (drawDrag ? posDrag : sel.Range(r).caret);
 		const int offset = posCaret.Position() - posLineStart;
 		const int spaceWidth = static_cast<int>(vsDraw.styles[ll->EndLineStyle()].spaceWidth);
 		const int virtualOffset = posCaret.VirtualSpace() * spaceWidth;
 		if (ll->InLine(offset, subLine) && offset <= ll->numCharsBeforeEOL) {
-			int xposCaret = ll->positions[offset] + virtualOffset - ll->positions[ll->LineStart(subLine)];
+			int xposCaret = ll->positions[offset] + virtualOffset - ll->SubLineStart(subLine);
 			if (ll->wrapIndent != 0) {
 				int lineStart = ll->LineStart(subLine);
 				if (lineStart != 0)	// Wrapped
@@ -3451,7 +3879,15 @@ void Editor::Paint(Surface *surfaceWindow, PRectangle rcArea) {
 	//Platform::DebugPrintf("Paint:%1d (%3d,%3d) ... (%3d,%3d)\n",
 	//	paintingAllText, rcArea.left, rcArea.top, rcArea.right, rcArea.bottom);
 
-	StyleToPositionInView(PositionAfterArea(rcArea));
+	paintStatistics.Reset();
+	PaintStatisticTimer ptPaint(paintStatistics, SC_PAINTSTAT_PAINTTIME);
+
+	{
+		PaintStatisticTimer ptStyle(paintStatistics, SC_PAINTSTAT_STYLETIME);
+		const int endStyledBefore = pdoc->GetEndStyled();
+		StyleToPositionInView(PositionAfterArea(rcArea));
+		paintStatistics.Add(SC_PAINTSTAT_BYTESSTYLED, pdoc->GetEndStyled() - endStyledBefore);
+	}
 
 	pixmapLine->Release();
 	RefreshStyleData();
@@ -3493,7 +3929,10 @@ void Editor::Paint(Surface *surfaceWindow, PRectangle rcArea) {
 	int startLineToWrap = cs.DocFromDisplay(topLine) - 5;
 	if (startLineToWrap < 0)
 		startLineToWrap = 0;
-	if (WrapLines(false, startLineToWrap)) {
+	PaintStatisticTimer ptWrap(paintStatistics, SC_PAINTSTAT_WRAPTIME);
+	bool wrapped = WrapLines(false, startLineToWrap);
+	ptWrap.Stop();
+	if (wrapped) {
 		// The wrapping process has changed the height of some lines so
 		// abandon this paint for a complete repaint.
 		if (AbandonPaint()) {
@@ -3596,13 +4035,16 @@ void Editor::Paint(Surface *surfaceWindow, PRectangle rcArea) {
 					(vs.braceBadLightIndicatorSet && (bracesMatchStyle == STYLE_BRACEBAD))) {
 					bracesIgnoreStyle = true;
 				}
-				Range rangeLine(pdoc->LineStart(lineDoc), pdoc->LineStart(lineDoc + 1));
+				Range rangeLine(pdoc->LineStart(lineDoc) + ll->windowStart, pdoc->LineStart(lineDoc + 1));
 				// Highlight the current braces if any
 				ll->SetBracesHighlight(rangeLine, braces, static_cast<char>(bracesMatchStyle),
 				        highlightGuideColumn * vs.spaceWidth, bracesIgnoreStyle);
 
 				// Draw the line
+				PaintStatisticTimer ptDraw(paintStatistics, SC_PAINTSTAT_DRAWTIME);
 				DrawLine(surface, vs, lineDoc, visibleLine, xStart, rcLine, ll, subLine);
+				ptDraw.Stop();
+				paintStatistics.Add(SC_PAINTSTAT_LINESDRAWN, 1);
 				//durPaint += et.Duration(true);
 
 				// Restore the previous styles for the brace highlights in case layout is in cache.
@@ -3641,7 +4083,7 @@ void Editor::Paint(Surface *surfaceWindow, PRectangle rcArea) {
 				}
 
 				lineWidthMaxSeen = Platform::Maximum(
-					    lineWidthMaxSeen, ll->positions[ll->numCharsInLine]);
+					    lineWidthMaxSeen, ll->xWindowStart + ll->positions[ll->numCharsInLine]);
 				//durCopy += et.Duration(true);
 			}
 
@@ -3675,7 +4117,11 @@ void Editor::Paint(Surface *surfaceWindow, PRectangle rcArea) {
 		//Platform::DebugPrintf(
 		//"Layout:%9.6g    Paint:%9.6g    Ratio:%9.6g   Copy:%9.6g   Total:%9.6g\n",
 		//durLayout, durPaint, durLayout / durPaint, durCopy, etWhole.Duration());
+		ptPaint.Stop();
 		NotifyPainted();
+		if (paintStatistics.collect)
+			NotifyPaintStatistics();
+		StyleInBackground();
 	}
 }
 
@@ -3965,21 +4411,48 @@ static bool cmpSelPtrs(const SelectionRange *a, const SelectionRange *b) {
 	return *a < *b;
 }
 
+static std::vector<SelectionRange *> SelectionsInOrder(Selection &sel) {
+	std::vector<SelectionRange *> selPtrs;
+	for (size_t r = 0; r < sel.Count(); r++) {
+		selPtrs.push_back(&sel.Range(r));
+	}
+	std::sort(selPtrs.begin(), selPtrs.end(), cmpSelPtrs);
+	return selPtrs;
+}
+
+/**
+ * Stops changes to the document moving every selection while a multiple selection
+ * edit works through the selections in document order. The edit moves each selection
+ * by the change in length made at the selections before it, so typing with many carets
+ * takes time proportional to the number of carets rather than its square.
+ */
+class AutoPlaceSelections {
+	bool &placed;
+	bool placedPrevious;
+public:
+	AutoPlaceSelections(bool &placed_, bool place) : placed(placed_), placedPrevious(placed_) {
+		placed = place;
+	}
+	~AutoPlaceSelections() {
+		placed = placedPrevious;
+	}
+};
+
 // AddCharUTF inserts an array of bytes which may or may not be in UTF-8.
 void Editor::AddCharUTF(char *s, unsigned int len, bool treatAsDBCS) {
 	FilterSelections();
 	{
 		UndoGroup ug(pdoc, (sel.Count() > 1) || !sel.Empty() || inOverstrike);
 
-		std::vector<SelectionRange *> selPtrs;
-		for (size_t r = 0; r < sel.Count(); r++) {
-			selPtrs.push_back(&sel.Range(r));
-		}
-		std::sort(selPtrs.begin(), selPtrs.end(), cmpSelPtrs);
-
-		for (std::vector<SelectionRange *>::reverse_iterator rit = selPtrs.rbegin();
-			rit != selPtrs.rend(); ++rit) {
-			SelectionRange *currentSel = *rit;
+		std::vector<SelectionRange *> selPtrs = SelectionsInOrder(sel);
+		AutoPlaceSelections aps(selectionsPlaced, true);
+		int lengthChange = 0;	// By the selections already processed
+		for (std::vector<SelectionRange *>::iterator it = selPtrs.begin();
+			it != selPtrs.end(); ++it) {
+			SelectionRange *currentSel = *it;
+			currentSel->caret.Add(lengthChange);
+			currentSel->anchor.Add(lengthChange);
+			const int lengthBefore = pdoc->Length();
 			if (!RangeContainsProtected(currentSel->Start().Position(),
 				currentSel->End().Position())) {
 				int positionInsert = currentSel->Start().Position();
@@ -4000,13 +4473,19 @@ void Editor::AddCharUTF(char *s, unsigned int len, bool treatAsDBCS) {
 					}
 				}
 				positionInsert = InsertSpace(positionInsert, currentSel->caret.VirtualSpace());
-				if (pdoc->InsertString(positionInsert, s, len)) {
-					currentSel->caret.SetPosition(positionInsert + len);
-					currentSel->anchor.SetPosition(positionInsert + len);
+				const bool inserted = pdoc->InsertString(positionInsert, s, len);
+				if (inserted) {
+					positionInsert += len;
+				}
+				// Leave the selection alone when the document refused the change
+				if (inserted || (pdoc->Length() != lengthBefore)) {
+					currentSel->caret.SetPosition(positionInsert);
+					currentSel->anchor.SetPosition(positionInsert);
 				}
 				currentSel->ClearVirtualSpace();
-				// If in wrap mode rewrap current line so EnsureCaretVisible has accurate information
-				if (wrapState != eWrapNone) {
+				// If in wrap mode rewrap current line so EnsureCaretVisible has accurate information.
+				// Other lines are rewrapped later as they were marked as needing it when changed.
+				if ((wrapState != eWrapNone) && (currentSel == &sel.RangeMain())) {
 					AutoSurface surface(this);
 					if (surface) {
 						if (WrapOneLine(surface, pdoc->LineFromPosition(positionInsert))) {
@@ -4017,6 +4496,7 @@ void Editor::AddCharUTF(char *s, unsigned int len, bool treatAsDBCS) {
 					}
 				}
 			}
+			lengthChange += pdoc->Length() - lengthBefore;
 		}
 	}
 	if (wrapState != eWrapNone) {
@@ -4110,13 +4590,21 @@ void Editor::ClearSelection(bool retainMultipleSelections) {
 	if (!sel.IsRectangular() && !retainMultipleSelections)
 		FilterSelections();
 	UndoGroup ug(pdoc);
-	for (size_t r=0; r<sel.Count(); r++) {
-		if (!sel.Range(r).Empty()) {
-			if (!RangeContainsProtected(sel.Range(r).Start().Position(),
-				sel.Range(r).End().Position())) {
-				pdoc->DeleteChars(sel.Range(r).Start().Position(),
-					sel.Range(r).Length());
-				sel.Range(r) = sel.Range(r).Start();
+	std::vector<SelectionRange *> selPtrs = SelectionsInOrder(sel);
+	AutoPlaceSelections aps(selectionsPlaced, true);
+	int lengthChange = 0;
+	for (std::vector<SelectionRange *>::iterator it = selPtrs.begin(); it != selPtrs.end(); ++it) {
+		SelectionRange *currentSel = *it;
+		currentSel->caret.Add(lengthChange);
+		currentSel->anchor.Add(lengthChange);
+		if (!currentSel->Empty()) {
+			if (!RangeContainsProtected(currentSel->Start().Position(),
+				currentSel->End().Position())) {
+				const int lengthBefore = pdoc->Length();
+				pdoc->DeleteChars(currentSel->Start().Position(),
+					currentSel->Length());
+				*currentSel = currentSel->Start();
+				lengthChange += pdoc->Length() - lengthBefore;
 			}
 		}
 	}
@@ -4230,21 +4718,29 @@ void Editor::Clear() {
 			singleVirtual = true;
 		}
 		UndoGroup ug(pdoc, (sel.Count() > 1) || singleVirtual);
-		for (size_t r=0; r<sel.Count(); r++) {
-			if (!RangeContainsProtected(sel.Range(r).caret.Position(), sel.Range(r).caret.Position() + 1)) {
-				if (sel.Range(r).Start().VirtualSpace()) {
-					if (sel.Range(r).anchor < sel.Range(r).caret)
-						sel.Range(r) = SelectionPosition(InsertSpace(sel.Range(r).anchor.Position(), sel.Range(r).anchor.VirtualSpace()));
+		std::vector<SelectionRange *> selPtrs = SelectionsInOrder(sel);
+		AutoPlaceSelections aps(selectionsPlaced, true);
+		int lengthChange = 0;
+		for (std::vector<SelectionRange *>::iterator it = selPtrs.begin(); it != selPtrs.end(); ++it) {
+			SelectionRange *currentSel = *it;
+			currentSel->caret.Add(lengthChange);
+			currentSel->anchor.Add(lengthChange);
+			const int lengthBefore = pdoc->Length();
+			if (!RangeContainsProtected(currentSel->caret.Position(), currentSel->caret.Position() + 1)) {
+				if (currentSel->Start().VirtualSpace()) {
+					if (currentSel->anchor < currentSel->caret)
+						*currentSel = SelectionPosition(InsertSpace(currentSel->anchor.Position(), currentSel->anchor.VirtualSpace()));
 					else
-						sel.Range(r) = SelectionPosition(InsertSpace(sel.Range(r).caret.Position(), sel.Range(r).caret.VirtualSpace()));
+						*currentSel = SelectionPosition(InsertSpace(currentSel->caret.Position(), currentSel->caret.VirtualSpace()));
 				}
-				if ((sel.Count() == 1) || !IsEOLChar(pdoc->CharAt(sel.Range(r).caret.Position()))) {
-					pdoc->DelChar(sel.Range(r).caret.Position());
-					sel.Range(r).ClearVirtualSpace();
+				if ((sel.Count() == 1) || !IsEOLChar(pdoc->CharAt(currentSel->caret.Position()))) {
+					pdoc->DelChar(currentSel->caret.Position());
+					currentSel->ClearVirtualSpace();
 				}  // else multiple selection so don't eat line ends
 			} else {
-				sel.Range(r).ClearVirtualSpace();
+				currentSel->ClearVirtualSpace();
 			}
+			lengthChange += pdoc->Length() - lengthBefore;
 		}
 	} else {
 		ClearSelection();
@@ -4292,16 +4788,33 @@ void Editor::DelCharBack(bool allowLineStartDeletion) {
 		allowLineStartDeletion = false;
 	UndoGroup ug(pdoc, (sel.Count() > 1) || !sel.Empty());
 	if (sel.Empty()) {
-		for (size_t r=0; r<sel.Count(); r++) {
-			if (!RangeContainsProtected(sel.Range(r).caret.Position(), sel.Range(r).caret.Position() + 1)) {
-				if (sel.Range(r).caret.VirtualSpace()) {
-					sel.Range(r).caret.SetVirtualSpace(sel.Range(r).caret.VirtualSpace() - 1);
-					sel.Range(r).anchor.SetVirtualSpace(sel.Range(r).caret.VirtualSpace());
+		std::vector<SelectionRange *> selPtrs = SelectionsInOrder(sel);
+		// Unindenting changes text before the caret so carets sharing a line must
+		// be moved by the document
+		bool place = true;
+		for (size_t r = 1; r < selPtrs.size(); r++) {
+			if (pdoc->LineFromPosition(selPtrs[r-1]->caret.Position()) ==
+				pdoc->LineFromPosition(selPtrs[r]->caret.Position()))
+				place = false;
+		}
+		AutoPlaceSelections aps(selectionsPlaced, place);
+		int lengthChange = 0;
+		for (std::vector<SelectionRange *>::iterator it = selPtrs.begin(); it != selPtrs.end(); ++it) {
+			SelectionRange *currentSel = *it;
+			if (place) {
+				currentSel->caret.Add(lengthChange);
+				currentSel->anchor.Add(lengthChange);
+			}
+			const int lengthBefore = pdoc->Length();
+			if (!RangeContainsProtected(currentSel->caret.Position(), currentSel->caret.Position() + 1)) {
+				if (currentSel->caret.VirtualSpace()) {
+					currentSel->caret.SetVirtualSpace(currentSel->caret.VirtualSpace() - 1);
+					currentSel->anchor.SetVirtualSpace(currentSel->caret.VirtualSpace());
 				} else {
-					int lineCurrentPos = pdoc->LineFromPosition(sel.Range(r).caret.Position());
-					if (allowLineStartDeletion || (pdoc->LineStart(lineCurrentPos) != sel.Range(r).caret.Position())) {
-						if (pdoc->GetColumn(sel.Range(r).caret.Position()) <= pdoc->GetLineIndentation(lineCurrentPos) &&
-								pdoc->GetColumn(sel.Range(r).caret.Position()) > 0 && pdoc->backspaceUnindents) {
+					int lineCurrentPos = pdoc->LineFromPosition(currentSel->caret.Position());
+					if (allowLineStartDeletion || (pdoc->LineStart(lineCurrentPos) != currentSel->caret.Position())) {
+						if (pdoc->GetColumn(currentSel->caret.Position()) <= pdoc->GetLineIndentation(lineCurrentPos) &&
+								pdoc->GetColumn(currentSel->caret.Position()) > 0 && pdoc->backspaceUnindents) {
 							UndoGroup ugInner(pdoc, !ug.Needed());
 							int indentation = pdoc->GetLineIndentation(lineCurrentPos);
 							int indentationStep = pdoc->IndentSize();
@@ -4311,16 +4824,22 @@ void Editor::DelCharBack(bool allowLineStartDeletion) {
 								pdoc->SetLineIndentation(lineCurrentPos, indentation - (indentation % indentationStep));
 							}
 							// SetEmptySelection
-							sel.Range(r) = SelectionRange(pdoc->GetLineIndentPosition(lineCurrentPos),
+							*currentSel = SelectionRange(pdoc->GetLineIndentPosition(lineCurrentPos),
 								pdoc->GetLineIndentPosition(lineCurrentPos));
 						} else {
-							pdoc->DelCharBack(sel.Range(r).caret.Position());
+							const int pos = currentSel->caret.Position();
+							pdoc->DelCharBack(pos);
+							if (place) {
+								currentSel->caret.SetPosition(pos + pdoc->Length() - lengthBefore);
+								currentSel->anchor.SetPosition(currentSel->caret.Position());
+							}
 						}
 					}
 				}
 			} else {
-				sel.Range(r).ClearVirtualSpace();
+				currentSel->ClearVirtualSpace();
 			}
+			lengthChange += pdoc->Length() - lengthBefore;
 		}
 	} else {
 		ClearSelection();
@@ -4427,6 +4946,19 @@ void Editor::NotifyPainted() {
 	NotifyParent(scn);
 }
 
+void Editor::NotifyPaintStatistics() {
+	SCNotification scn = {0};
+	scn.nmhdr.code = SCN_PAINTSTATISTICS;
+	NotifyParent(scn);
+}
+
+void Editor::NotifyStyled(int position) {
+	SCNotification scn = {0};
+	scn.nmhdr.code = SCN_STYLED;
+	scn.position = position;
+	NotifyParent(scn);
+}
+
 void Editor::NotifyIndicatorClick(bool click, int position, bool shift, bool ctrl, bool alt) {
 	int mask = pdoc->decorations.AllOnFor(position);
 	if ((click && mask) || pdoc->decorations.clickNotified) {
@@ -4498,6 +5030,9 @@ void Editor::NotifySavePoint(Document *, void *, bool atSavePoint) {
 void Editor::CheckModificationForWrap(DocModification mh) {
 	if (mh.modificationType & (SC_MOD_INSERTTEXT | SC_MOD_DELETETEXT)) {
 		llc.Invalidate(LineLayout::llCheckTextAndStyle);
+		int lineModified = pdoc->LineFromPosition(mh.position);
+		llc.InvalidateCheckpoints(lineModified, mh.position - pdoc->LineStart(lineModified),
+			(mh.linesAdded != 0) ? wrapLineLarge : lineModified);
 		if (wrapState != eWrapNone) {
 			int lineDoc = pdoc->LineFromPosition(mh.position);
 			int lines = Platform::Maximum(0, mh.linesAdded);
@@ -4534,6 +5069,12 @@ static inline int MovePositionForDeletion(int position, int startDeletion, int l
 }
 
 void Editor::NotifyModified(Document *, DocModification mh, void *) {
+	if (mh.modificationType & SC_MOD_COALESCED) {
+		// The view has already been updated for each of the changes summarised
+		if (coalesceModEvents)
+			NotifyContainerModified(mh);
+		return;
+	}
 	ContainerNeedsUpdate(SC_UPDATE_CONTENT);
 	if (paintState == painting) {
 		CheckForChangeOutsidePaint(Range(mh.position, mh.position + mh.length));
@@ -4569,15 +5110,20 @@ void Editor::NotifyModified(Document *, DocModification mh, void *) {
 		}
 		if (mh.modificationType & SC_MOD_CHANGESTYLE) {
 			llc.Invalidate(LineLayout::llCheckTextAndStyle);
+			int lineStyled = pdoc->LineFromPosition(mh.position);
+			llc.InvalidateCheckpoints(lineStyled, mh.position - pdoc->LineStart(lineStyled),
+				pdoc->LineFromPosition(mh.position + mh.length));
 		}
 	} else {
 		// Move selection and brace highlights
 		if (mh.modificationType & SC_MOD_INSERTTEXT) {
-			sel.MovePositions(true, mh.position, mh.length);
+			if (!selectionsPlaced)
+				sel.MovePositions(true, mh.position, mh.length);
 			braces[0] = MovePositionForInsertion(braces[0], mh.position, mh.length);
 			braces[1] = MovePositionForInsertion(braces[1], mh.position, mh.length);
 		} else if (mh.modificationType & SC_MOD_DELETETEXT) {
-			sel.MovePositions(false, mh.position, mh.length);
+			if (!selectionsPlaced)
+				sel.MovePositions(false, mh.position, mh.length);
 			braces[0] = MovePositionForDeletion(braces[0], mh.position, mh.length);
 			braces[1] = MovePositionForDeletion(braces[1], mh.position, mh.length);
 		}
@@ -4608,6 +5154,8 @@ void Editor::NotifyModified(Document *, DocModification mh, void *) {
 			} else {
 				cs.DeleteLines(lineOfPos, -mh.linesAdded);
 			}
+			// Margin text moves with its line
+			marginRows.InvalidateLine(lineOfPos, true);
 		}
 		if (mh.modificationType & SC_MOD_CHANGEANNOTATION) {
 			int lineDoc = pdoc->LineFromPosition(mh.position);
@@ -4649,6 +5197,8 @@ void Editor::NotifyModified(Document *, DocModification mh, void *) {
 	}
 
 	if ((mh.modificationType & SC_MOD_CHANGEMARKER) || (mh.modificationType & SC_MOD_CHANGEMARGIN)) {
+		// Rows already drawn in the margin pixmap may be reused by the current paint
+		marginRows.InvalidateLine(mh.line, (mh.modificationType & SC_MOD_CHANGEFOLD) != 0);
 		if ((paintState == notPainting) || !PaintContainsMargin()) {
 			if (mh.modificationType & SC_MOD_CHANGEFOLD) {
 				// Fold changes can affect the drawing of following lines so redraw whole margin
@@ -4665,9 +5215,17 @@ void Editor::NotifyModified(Document *, DocModification mh, void *) {
 		Redraw();
 	}
 
+	// Text changes inside a batch are summarised again when the batch ends
+	const int textChange = SC_MOD_INSERTTEXT | SC_MOD_DELETETEXT | SC_MOD_BEFOREINSERT | SC_MOD_BEFOREDELETE;
+	if (coalesceModEvents && pdoc->InBatch() && (mh.modificationType & textChange))
+		mh.modificationType |= SC_COALESCEDSTEP;
+	NotifyContainerModified(mh);
+}
+
+void Editor::NotifyContainerModified(const DocModification &mh) {
 	// If client wants to see this modification
 	if (mh.modificationType & modEventMask) {
-		if ((mh.modificationType & (SC_MOD_CHANGESTYLE | SC_MOD_CHANGEINDICATOR)) == 0) {
+		if ((mh.modificationType & (SC_MOD_CHANGESTYLE | SC_MOD_CHANGEINDICATOR | SC_MOD_COALESCED)) == 0) {
 			// Real modification made to text of document.
 			NotifyChange();	// Send EN_CHANGE
 		}
@@ -5062,7 +5620,10 @@ int Editor::StartEndDisplayLine(int pos, bool start) {
 		unsigned int posLineStart = pdoc->LineStart(line);
 		LayoutLine(line, surface, vs, ll, wrapWidth);
 		int posInLine = pos - posLineStart;
-		if (posInLine <= ll->maxLineLength) {
+		if (ll->windowed) {
+			// Windowed lines are never wrapped
+			posRet = start ? posLineStart : pdoc->LineEnd(line);
+		} else if (posInLine <= ll->maxLineLength) {
 			for (int subLine = 0; subLine < ll->lines; subLine++) {
 				if ((posInLine >= ll->LineStart(subLine)) && (posInLine <= ll->LineStart(subLine + 1))) {
 					if (start) {
@@ -5830,9 +6391,7 @@ char *Editor::CopyRange(int start, int end) {
 	if (start < end) {
 		int len = end - start;
 		text = new char[len + 1];
-		for (int i = 0; i < len; i++) {
-			text[i] = pdoc->CharAt(start + i);
-		}
+		pdoc->GetCharRange(text, start, len);
 		text[len] = '\0';
 	}
 	return text;
@@ -5878,11 +6437,9 @@ void Editor::CopySelectionRange(SelectionText *ss, bool allowLineCopy) {
 			std::sort(rangesInOrder.begin(), rangesInOrder.end());
 		for (size_t r=0; r<rangesInOrder.size(); r++) {
 			SelectionRange current = rangesInOrder[r];
-			for (int i = current.Start().Position();
-			        i < current.End().Position();
-			        i++) {
-				text[j++] = pdoc->CharAt(i);
-			}
+			const int rangeLength = current.End().Position() - current.Start().Position();
+			pdoc->GetCharRange(text + j, current.Start().Position(), rangeLength);
+			j += rangeLength;
 			if (sel.selType == Selection::selRectangle) {
 				if (pdoc->eolMode != SC_EOL_LF) {
 					text[j++] = '\r';
@@ -5898,6 +6455,23 @@ void Editor::CopySelectionRange(SelectionText *ss, bool allowLineCopy) {
 	}
 }
 
+// Large selections that are most of the document are kept as ranges of a snapshot so
+// their text is only copied if it is asked for. Sharing the snapshot costs at most one
+// copy of the document when it is next changed.
+void Editor::DeferSelectionRange(SelectionText *ss) {
+	const int length = sel.Length();
+	if (sel.Empty() || (length < DeferredSelection::minimumLength) || (length < pdoc->Length() / 2)) {
+		CopySelectionRange(ss);
+		return;
+	}
+	std::vector<SelectionRange> rangesInOrder = sel.RangesCopy();
+	if (sel.selType == Selection::selRectangle)
+		std::sort(rangesInOrder.begin(), rangesInOrder.end());
+	ss->Defer(new DeferredSelection(pdoc->CreateTextSnapshot(), rangesInOrder,
+		pdoc->eolMode, sel.selType == Selection::selRectangle, pdoc->dbcsCodePage,
+		vs.styles[STYLE_DEFAULT].characterSet, sel.IsRectangular(), sel.selType == Selection::selLines));
+}
+
 void Editor::CopyRangeToClipboard(int start, int end) {
 	start = pdoc->ClampPositionIntoDocument(start);
 	end = pdoc->ClampPositionIntoDocument(end);
@@ -6590,12 +7164,14 @@ bool Editor::Idle() {
 			wrappingDone = true;
 	}
 
+	bool stylingDone = IdleStyleAfterVisible();
+
 	// Add more idle things to do here, but make sure idleDone is
 	// set correctly before the function returns. returning
 	// false will stop calling this idle funtion until SetIdle() is
 	// called again.
 
-	idleDone = wrappingDone; // && thatDone && theOtherThingDone...
+	idleDone = wrappingDone && stylingDone; // && thatDone && theOtherThingDone...
 
 	return !idleDone;
 }
@@ -6635,6 +7211,20 @@ void Editor::StyleToPositionInView(Position pos) {
 		// so require rest of window to be styled.
 		pdoc->EnsureStyledTo(endWindow);
 	}
+	if (FoldLevelsDisplayed())
+		pdoc->EnsureFoldedTo(pos);
+}
+
+// Fold levels are drawn in fold margins, as fold lines and by indentation guides
+// that look at fold headers.
+bool Editor::FoldLevelsDisplayed() const {
+	if (foldFlags || (vs.viewIndentationGuides == ivLookForward) || (vs.viewIndentationGuides == ivLookBoth))
+		return true;
+	for (int margin = 0; margin < ViewStyle::margins; margin++) {
+		if ((vs.ms[margin].width > 0) && (vs.ms[margin].mask & SC_MASK_FOLDERS))
+			return true;
+	}
+	return false;
 }
 
 void Editor::IdleStyling() {
@@ -6647,6 +7237,34 @@ void Editor::IdleStyling() {
 		needUpdateUI = 0;
 	}
 	styleNeeded.Reset();
+	StyleInBackground();
+}
+
+// Only the text in view is styled synchronously so style the remainder
+// of the document while idle.
+void Editor::StyleInBackground() {
+	if ((idleStyling != SC_IDLESTYLING_NONE) && (pdoc->GetEndStyled() < pdoc->Length()))
+		SetIdle(true);
+}
+
+// Style some of the text after the view without delaying the user for long.
+// Returns true when there is no more to style.
+bool Editor::IdleStyleAfterVisible() {
+	if ((idleStyling == SC_IDLESTYLING_NONE) || (pdoc->GetEndStyled() >= pdoc->Length()))
+		return true;
+	const double secondsAllowed = 0.02;
+	const int linesPerStep = 500;
+	ElapsedTime et;
+	int endStyledBefore;
+	do {
+		endStyledBefore = pdoc->GetEndStyled();
+		int lineNext = pdoc->LineFromPosition(endStyledBefore) + linesPerStep;
+		pdoc->EnsureStyledTo(pdoc->LineStart(lineNext));
+	} while ((pdoc->GetEndStyled() < pdoc->Length()) && (et.Duration() < secondsAllowed) &&
+		(pdoc->GetEndStyled() > endStyledBefore));
+	NotifyStyled(pdoc->GetEndStyled());
+	// Stop if a container lexer did not respond
+	return (pdoc->GetEndStyled() >= pdoc->Length()) || (pdoc->GetEndStyled() <= endStyledBefore);
 }
 
 void Editor::QueueStyling(int upTo) {
@@ -6739,6 +7357,7 @@ void Editor::SetDocPointer(Document *document) {
 	cs.InsertLines(0, pdoc->LinesTotal() - 1);
 	SetAnnotationHeights(0, pdoc->LinesTotal());
 	llc.Deallocate();
+	marginRows.Invalidate();
 	NeedWrapping();
 
 	pdoc->AddWatcher(this, 0);
@@ -6787,6 +7406,7 @@ void Editor::Expand(int &line, bool doExpand) {
 
 void Editor::ToggleContraction(int line) {
 	if (line >= 0) {
+		pdoc->EnsureFoldedTo(pdoc->LineStart(line + 1));
 		if ((pdoc->GetLevel(line) & SC_FOLDLEVELHEADERFLAG) == 0) {
 			line = pdoc->GetFoldParent(line);
 			if (line < 0)
@@ -6844,6 +7464,7 @@ void Editor::EnsureLineVisible(int lineDoc, bool enforcePolicy) {
 	WrapLines(true, -1);
 
 	if (!cs.GetVisible(lineDoc)) {
+		pdoc->EnsureFoldedTo(pdoc->LineStart(lineDoc + 1));
 		int lookLine = lineDoc;
 		int lookLineLevel = pdoc->GetLevel(lookLine);
 		while ((lookLine > 0) && (lookLineLevel & SC_FOLDLEVELWHITEFLAG)) {
@@ -8235,6 +8856,7 @@ sptr_t Editor::WndProc(unsigned int iMessage, uptr_t wParam, sptr_t lParam) {
 		}
 
 	case SCI_GETFOLDLEVEL:
+		pdoc->EnsureFoldedTo(pdoc->LineStart(wParam + 1));
 		return pdoc->GetLevel(wParam);
 
 	case SCI_GETLASTCHILD:
@@ -8676,6 +9298,13 @@ sptr_t Editor::WndProc(unsigned int iMessage, uptr_t wParam, sptr_t lParam) {
 	case SCI_GETMODEVENTMASK:
 		return modEventMask;
 
+	case SCI_SETCOALESCEMODEVENTS:
+		coalesceModEvents = wParam != 0;
+		return 0;
+
+	case SCI_GETCOALESCEMODEVENTS:
+		return coalesceModEvents;
+
 	case SCI_CONVERTEOLS:
 		pdoc->ConvertLineEnds(wParam);
 		SetSelection(sel.MainCaret(), sel.MainAnchor());	// Ensure selection inside document
@@ -8849,6 +9478,14 @@ sptr_t Editor::WndProc(unsigned int iMessage, uptr_t wParam, sptr_t lParam) {
 	case SCI_GETCHARACTERPOINTER:
 		return reinterpret_cast<sptr_t>(pdoc->BufferPointer());
 
+	case SCI_CREATETEXTSNAPSHOT:
+		return reinterpret_cast<sptr_t>(static_cast<Sci_TextSnapshot *>(pdoc->CreateTextSnapshot()));
+
+	case SCI_RELEASETEXTSNAPSHOT:
+		if (lParam)
+			static_cast<TextSnapshot *>(reinterpret_cast<Sci_TextSnapshot *>(lParam))->Release();
+		return 0;
+
 	case SCI_SETEXTRAASCENT:
 		vs.extraAscent = wParam;
 		InvalidateStyleRedraw();
@@ -9054,6 +9691,7 @@ sptr_t Editor::WndProc(unsigned int iMessage, uptr_t wParam, sptr_t lParam) {
 		return sel.Main();
 
 	case SCI_SETSELECTIONNCARET:
+		sel.SetLinesOrdered(false);
 		sel.Range(wParam).caret.SetPosition(lParam);
 		Redraw();
 		break;
@@ -9062,6 +9700,7 @@ sptr_t Editor::WndProc(unsigned int iMessage, uptr_t wParam, sptr_t lParam) {
 		return sel.Range(wParam).caret.Position();
 
 	case SCI_SETSELECTIONNANCHOR:
+		sel.SetLinesOrdered(false);
 		sel.Range(wParam).anchor.SetPosition(lParam);
 		Redraw();
 		break;
@@ -9085,6 +9724,7 @@ sptr_t Editor::WndProc(unsigned int iMessage, uptr_t wParam, sptr_t lParam) {
 		return sel.Range(wParam).anchor.VirtualSpace();
 
 	case SCI_SETSELECTIONNSTART:
+		sel.SetLinesOrdered(false);
 		sel.Range(wParam).anchor.SetPosition(lParam);
 		Redraw();
 		break;
@@ -9093,6 +9733,7 @@ sptr_t Editor::WndProc(unsigned int iMessage, uptr_t wParam, sptr_t lParam) {
 		return sel.Range(wParam).Start().Position();
 
 	case SCI_SETSELECTIONNEND:
+		sel.SetLinesOrdered(false);
 		sel.Range(wParam).caret.SetPosition(lParam);
 		Redraw();
 		break;
@@ -9202,6 +9843,25 @@ sptr_t Editor::WndProc(unsigned int iMessage, uptr_t wParam, sptr_t lParam) {
 	case SCI_GETIDENTIFIER:
 		return GetCtrlID();
 
+	case SCI_SETPAINTSTATISTICS:
+		paintStatistics.collect = wParam != 0;
+		paintStatistics.Reset();
+		break;
+
+	case SCI_GETPAINTSTATISTICS:
+		return paintStatistics.collect;
+
+	case SCI_GETPAINTSTATISTIC:
+		return paintStatistics.Value(wParam);
+
+	case SCI_SETIDLESTYLING:
+		idleStyling = wParam;
+		StyleInBackground();
+		break;
+
+	case SCI_GETIDLESTYLING:
+		return idleStyling;
+
 	default:
 		return DefWndProc(iMessage, wParam, lParam);
 	}
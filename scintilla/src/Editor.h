@@ -65,6 +65,81 @@ public:
 	}
 };
 
+/**
+ * Time spent and work done during the most recent paint, collected when
+ * enabled by the container. Times are accumulated in seconds.
+ */
+class PaintStatistics {
+	enum { statistics = SC_PAINTSTAT_LINESDRAWN + 1 };
+	double values[statistics];
+public:
+	bool collect;
+
+	PaintStatistics() : collect(false) {
+		Reset();
+	}
+	void Reset() {
+		for (int i = 0; i < statistics; i++)
+			values[i] = 0.0;
+	}
+	void Add(int statistic, double amount) {
+		if (collect)
+			values[statistic] += amount;
+	}
+	int Value(int statistic) const;
+};
+
+/**
+ * Adds the time from its creation until stopped or destroyed to a paint statistic.
+ * The clock is only read when statistics are being collected.
+ */
+class PaintStatisticTimer {
+	PaintStatistics &ps;
+	int statistic;
+	ElapsedTime *et;
+	// Private so PaintStatisticTimer objects can not be copied
+	PaintStatisticTimer(const PaintStatisticTimer &);
+	PaintStatisticTimer &operator=(const PaintStatisticTimer &);
+public:
+	PaintStatisticTimer(PaintStatistics &ps_, int statistic_) :
+		ps(ps_), statistic(statistic_), et(ps_.collect ? new ElapsedTime() : 0) {
+	}
+	~PaintStatisticTimer() {
+		Stop();
+	}
+	void Stop() {
+		if (et) {
+			ps.Add(statistic, et->Duration());
+			delete et;
+			et = 0;
+		}
+	}
+};
+
+/**
+ * The ranges of a large selection in a snapshot of the document so that its text is
+ * only copied if something asks for it.
+ */
+class DeferredSelection {
+	TextSnapshot *snapshot;
+	std::vector<SelectionRange> ranges;	///< In the order their text is joined
+	int eolMode;
+	bool lineEnds;	///< Follow each range with a line end as for rectangular selections
+	// Private so DeferredSelection objects can not be copied
+	DeferredSelection(const DeferredSelection &);
+	DeferredSelection &operator=(const DeferredSelection &);
+public:
+	int codePage;
+	int characterSet;
+	bool rectangular;
+	bool lineCopy;
+	enum { minimumLength = 0x100000 };
+	DeferredSelection(TextSnapshot *snapshot_, const std::vector<SelectionRange> &ranges_,
+		int eolMode_, bool lineEnds_, int codePage_, int characterSet_, bool rectangular_, bool lineCopy_);
+	~DeferredSelection();
+	char *Retrieve(int *length) const;
+};
+
 /**
  * Hold a piece of text selected for copying or dragging.
  * The text is expected to hold a terminating '\0' and this is counted in len.
@@ -77,7 +152,8 @@ public:
 	bool lineCopy;
 	int codePage;
 	int characterSet;
-	SelectionText() : s(0), len(0), rectangular(false), lineCopy(false), codePage(0), characterSet(0) {}
+	DeferredSelection *deferred;	///< Copied into s by Retrieve
+	SelectionText() : s(0), len(0), rectangular(false), lineCopy(false), codePage(0), characterSet(0), deferred(0) {}
 	~SelectionText() {
 		Free();
 	}
@@ -86,6 +162,8 @@ public:
 	}
 	void Set(char *s_, int len_, int codePage_, int characterSet_, bool rectangular_, bool lineCopy_) {
 		delete []s;
+		delete deferred;
+		deferred = 0;
 		s = s_;
 		if (s)
 			len = len_;
@@ -99,6 +177,8 @@ public:
 	void Copy(const char *s_, int len_, int codePage_, int characterSet_, bool rectangular_, bool lineCopy_) {
 		delete []s;
 		s = 0;
+		delete deferred;
+		deferred = 0;
 		s = new char[len_];
 		len = len_;
 		for (int i = 0; i < len_; i++) {
@@ -112,6 +192,82 @@ public:
 	void Copy(const SelectionText &other) {
 		Copy(other.s, other.len, other.codePage, other.characterSet, other.rectangular, other.lineCopy);
 	}
+	void Defer(DeferredSelection *deferred_) {
+		Set(0, 0, deferred_->codePage, deferred_->characterSet, deferred_->rectangular, deferred_->lineCopy);
+		deferred = deferred_;
+	}
+	void Retrieve() {
+		if (deferred) {
+			int length = 0;
+			char *text = deferred->Retrieve(&length);
+			Set(text, length, codePage, characterSet, rectangular, lineCopy);
+		}
+	}
+	bool HasText() const {
+		return s || deferred;
+	}
+};
+
+/**
+ * What the ranges of a rectangular selection were last built from. When only the
+ * caret line moves, the ranges of the lines that stay in the rectangle are kept and
+ * just the lines added are laid out.
+ */
+class RectangularBuild {
+public:
+	int lineAnchor;
+	int lineCaret;
+	int xAnchor;
+	int xCaret;
+	bool virtualSpace;
+	unsigned int layoutGeneration;	///< LineLayoutCache::Generation when built
+
+	RectangularBuild() : lineAnchor(-1), lineCaret(-1), xAnchor(0), xCaret(0),
+		virtualSpace(false), layoutGeneration(0) {}
+};
+
+/**
+ * What was drawn for one margin on one row of the margin pixmap.
+ */
+class MarginRow {
+public:
+	int line;	///< Document line or -1 for rows after the end of the document
+	int subLine;
+	int marks;	///< Marker and fold symbols after masking
+	int fold;	///< LineMarker::typeOfFold used for highlighted fold symbols
+	int level;	///< Fold level when level numbers are displayed
+
+	MarginRow() : line(-2), subLine(0), marks(0), fold(0), level(0) {}
+	MarginRow(int line_, int subLine_, int marks_, int fold_, int level_) :
+		line(line_), subLine(subLine_), marks(marks_), fold(fold_), level(level_) {}
+	bool operator==(const MarginRow &other) const {
+		return (line == other.line) && (subLine == other.subLine) &&
+			(marks == other.marks) && (fold == other.fold) && (level == other.level);
+	}
+};
+
+/**
+ * Remembers the contents of each row of the buffered margin pixmap so that only
+ * rows whose line, markers or fold state have changed are drawn again.
+ */
+class MarginRowCache {
+	MarginRow *rows;
+	int lines;
+	int margins;
+public:
+	int topLine;	///< The first display line when the pixmap was last drawn
+
+	MarginRowCache();
+	~MarginRowCache();
+	void Allocate(int lines_, int margins_);
+	void Invalidate();
+	void InvalidateLine(int line, bool allAfter);
+	void Scroll(int linesUp);
+	int Lines() const {
+		return lines;
+	}
+	bool Matches(int row, int margin, const MarginRow &mr) const;
+	void Set(int row, int margin, const MarginRow &mr);
 };
 
 /**
@@ -175,9 +331,12 @@ protected:	// ScintillaBase subclass needs access to much of Editor
 
 	Surface *pixmapLine;
 	Surface *pixmapSelMargin;
+	Surface *pixmapSelMarginScroll;	///< Receives the margin pixmap moved by scrolling
 	Surface *pixmapSelPattern;
+	Surface *pixmapSelPatternOffset;	///< Pattern for rows starting on odd pixels
 	Surface *pixmapIndentGuide;
 	Surface *pixmapIndentGuideHighlight;
+	MarginRowCache marginRows;
 
 	LineLayoutCache llc;
 	PositionCache posCache;
@@ -227,11 +386,15 @@ protected:	// ScintillaBase subclass needs access to much of Editor
 	PRectangle rcPaint;
 	bool paintingAllText;
 	StyleNeeded styleNeeded;
+	PaintStatistics paintStatistics;
 
 	int modEventMask;
+	bool coalesceModEvents;	///< Also summarise the text changes of undo groups when the group ends
 
 	SelectionText drag;
 	Selection sel;
+	bool selectionsPlaced;	///< A multiple selection edit is positioning each selection itself
+	RectangularBuild rectangularBuild;
 	bool primarySelection;
 
 	int caretXPolicy;
@@ -268,6 +431,8 @@ protected:	// ScintillaBase subclass needs access to much of Editor
 
 	bool convertPastes;
 
+	int idleStyling;	///< SC_IDLESTYLING_NONE or SC_IDLESTYLING_AFTERVISIBLE
+
 	Document *pdoc;
 
 	Editor();
@@ -363,10 +528,18 @@ protected:	// ScintillaBase subclass needs access to much of Editor
 	void LinesSplit(int pixelWidth);
 
 	int SubstituteMarkerIfEmpty(int markerCheck, int markerDefault);
+	void FillMarginRow(Surface *surface, int margin, PRectangle rcRow);
 	void PaintSelMargin(Surface *surface, PRectangle &rc);
 	LineLayout *RetrieveLineLayout(int lineNumber);
+	bool LayoutMatchesDocument(ViewStyle &vstyle, LineLayout *ll, int position);
+	bool MeasureSegments(Surface *surface, ViewStyle &vstyle, LineLayout *ll, int start, int end, int xStart);
 	void LayoutLine(int line, Surface *surface, ViewStyle &vstyle, LineLayout *ll,
-		int width=LineLayout::wrapWidthInfinite);
+		int width=LineLayout::wrapWidthInfinite, int posTarget=-1, int xTarget=-1);
+	bool AddLineCheckpoint(Surface *surface, ViewStyle &vstyle, LineLayout *ll,
+		LineCheckpoints *lcp, int posLineStart, int lengthLayout);
+	void LayoutFill(ViewStyle &vstyle, LineLayout *ll, int position, int length);
+	void LayoutLineWindow(int line, Surface *surface, ViewStyle &vstyle, LineLayout *ll,
+		int posTarget, int xTarget);
 	ColourAllocated SelectionBackground(ViewStyle &vsDraw, bool main);
 	ColourAllocated TextBackground(ViewStyle &vsDraw, bool overrideBackground, ColourAllocated background, int inSelection, bool inHotspot, int styleMain, int i, LineLayout *ll);
 	void DrawIndentGuide(Surface *surface, int lineVisible, int lineHeight, int start, PRectangle rcSegment, bool highlight);
@@ -436,6 +609,8 @@ protected:	// ScintillaBase subclass needs access to much of Editor
 	void NotifyHotSpotReleaseClick(int position, bool shift, bool ctrl, bool alt);
 	void NotifyUpdateUI();
 	void NotifyPainted();
+	void NotifyPaintStatistics();
+	void NotifyStyled(int position);
 	void NotifyIndicatorClick(bool click, int position, bool shift, bool ctrl, bool alt);
 	bool NotifyMarginClick(Point pt, bool shift, bool ctrl, bool alt);
 	void NotifyNeedShown(int pos, int len);
@@ -446,6 +621,7 @@ protected:	// ScintillaBase subclass needs access to much of Editor
 	void NotifySavePoint(Document *document, void *userData, bool atSavePoint);
 	void CheckModificationForWrap(DocModification mh);
 	void NotifyModified(Document *document, DocModification mh, void *userData);
+	void NotifyContainerModified(const DocModification &mh);
 	void NotifyDeleted(Document *document, void *userData);
 	void NotifyStyleNeeded(Document *doc, void *userData, int endPos);
 	void NotifyLexerChanged(Document *doc, void *userData);
@@ -484,6 +660,7 @@ protected:	// ScintillaBase subclass needs access to much of Editor
 	virtual void CopyToClipboard(const SelectionText &selectedText) = 0;
 	char *CopyRange(int start, int end);
 	void CopySelectionRange(SelectionText *ss, bool allowLineCopy=false);
+	void DeferSelectionRange(SelectionText *ss);
 	void CopyRangeToClipboard(int start, int end);
 	void CopyText(int length, const char *text);
 	void SetDragPosition(SelectionPosition newPos);
@@ -514,7 +691,10 @@ protected:	// ScintillaBase subclass needs access to much of Editor
 
 	int PositionAfterArea(PRectangle rcArea);
 	void StyleToPositionInView(Position pos);
+	bool FoldLevelsDisplayed() const;
 	void IdleStyling();
+	void StyleInBackground();
+	bool IdleStyleAfterVisible();
 	virtual void QueueStyling(int upTo);
 
 	virtual bool PaintContains(PRectangle rc);
@@ -32,12 +32,16 @@ void LineMarker::RefreshColourPalette(Palette &pal, bool want) {
 void LineMarker::SetXPM(const char *textForm) {
 	delete pxpm;
 	pxpm = new XPM(textForm);
+	delete imageXPM;
+	imageXPM = new RGBAImage(*pxpm);
 	markType = SC_MARK_PIXMAP;
 }
 
 void LineMarker::SetXPM(const char *const *linesForm) {
 	delete pxpm;
 	pxpm = new XPM(linesForm);
+	delete imageXPM;
+	imageXPM = new RGBAImage(*pxpm);
 	markType = SC_MARK_PIXMAP;
 }
 
@@ -103,7 +107,15 @@ void LineMarker::Draw(Surface *surface, PRectangle &rcWhole, Font &fontForCharac
 
 
 	if ((markType == SC_MARK_PIXMAP) && (pxpm)) {
-		pxpm->Draw(surface, rcWhole);
+		// Draw the converted image rather than each run of the XPM, centred like XPM::Draw
+		const int width = imageXPM->GetWidth();
+		const int height = imageXPM->GetHeight();
+		if ((width > 0) && (height > 0)) {
+			int startX = rcWhole.left + (rcWhole.Width() - width) / 2;
+			int startY = rcWhole.top + (rcWhole.Height() - height) / 2;
+			PRectangle rcImage(startX, startY, startX + width, startY + height);
+			surface->DrawRGBAImage(rcImage, width, height, imageXPM->Pixels());
+		}
 		return;
 	}
 	if ((markType == SC_MARK_RGBAIMAGE) && (image)) {
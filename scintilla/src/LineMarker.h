@@ -25,6 +25,7 @@ public:
 	ColourPair backSelected;
 	int alpha;
 	XPM *pxpm;
+	RGBAImage *imageXPM;	///< pxpm converted once so it can be drawn in one operation
 	RGBAImage *image;
 	LineMarker() {
 		markType = SC_MARK_CIRCLE;
@@ -33,6 +34,7 @@ public:
 		backSelected = ColourDesired(0xff,0x00,0x00);
 		alpha = SC_ALPHA_NOALPHA;
 		pxpm = NULL;
+		imageXPM = NULL;
 		image = NULL;
 	}
 	LineMarker(const LineMarker &) {
@@ -43,10 +45,12 @@ public:
 		backSelected = ColourDesired(0xff,0x00,0x00);
 		alpha = SC_ALPHA_NOALPHA;
 		pxpm = NULL;
+		imageXPM = NULL;
 		image = NULL;
 	}
 	~LineMarker() {
 		delete pxpm;
+		delete imageXPM;
 		delete image;
 	}
 	LineMarker &operator=(const LineMarker &) {
@@ -58,6 +62,8 @@ public:
 		alpha = SC_ALPHA_NOALPHA;
 		delete pxpm;
 		pxpm = NULL;
+		delete imageXPM;
+		imageXPM = NULL;
 		delete image;
 		image = NULL;
 		return *this;
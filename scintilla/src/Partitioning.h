@@ -105,6 +105,20 @@ public:
 		stepPartition++;
 	}
 
+	/// Insert count partitions with ascending positions, equivalent to inserting each in turn
+	void InsertPartitions(int partition, const int *positions, int count) {
+		if (stepPartition < partition) {
+			ApplyStep(partition);
+		}
+		body->InsertFromArray(partition, positions, 0, count);
+		stepPartition += count;
+	}
+
+	/// Make room for partitions more partitions so they can be inserted without reallocation
+	void ReservePartitions(int partitions) {
+		body->ReAllocate(body->Length() + partitions + 1);
+	}
+
 	void SetPartitionStartPosition(int partition, int pos) {
 		ApplyStep(partition+1);
 		if ((partition < 0) || (partition > body->Length())) {
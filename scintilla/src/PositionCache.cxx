@@ -68,7 +68,10 @@ LineLayout::LineLayout(int maxLineLength_) :
 	hsEnd(0),
 	widthLine(wrapWidthInfinite),
 	lines(1),
-	wrapIndent(0) {
+	wrapIndent(0),
+	windowed(false),
+	windowStart(0),
+	xWindowStart(0) {
 	bracePreviousStyles[0] = 0;
 	bracePreviousStyles[1] = 0;
 	Resize(maxLineLength_);
@@ -206,9 +209,102 @@ int LineLayout::EndLineStyle() const {
 	return styles[numCharsBeforeEOL > 0 ? numCharsBeforeEOL-1 : 0];
 }
 
+/**
+ * The value to subtract from positions to get the x offset from the start of a sub line.
+ * For a windowed layout this includes the distance of the window from the line start.
+ */
+int LineLayout::SubLineStart(int line) const {
+	return positions[LineStart(line)] - xWindowStart;
+}
+
+void LineLayout::SetWindow(int windowStart_, int xWindowStart_) {
+	windowed = true;
+	windowStart = windowStart_;
+	xWindowStart = xWindowStart_;
+}
+
+void LineLayout::ClearWindow() {
+	windowed = false;
+	windowStart = 0;
+	xWindowStart = 0;
+}
+
+LineCheckpoints::LineCheckpoints() :
+	positions(0), xs(0), size(0), lineNumber(-1), len(0), clock(0) {
+}
+
+LineCheckpoints::~LineCheckpoints() {
+	delete []positions;
+	positions = 0;
+	delete []xs;
+	xs = 0;
+}
+
+void LineCheckpoints::Clear() {
+	len = 0;
+}
+
+void LineCheckpoints::Add(int position, int x) {
+	if (len >= size) {
+		int sizeNew = size * 2 + 64;
+		int *positionsNew = new int[sizeNew];
+		int *xsNew = new int[sizeNew];
+		for (int i = 0; i < len; i++) {
+			positionsNew[i] = positions[i];
+			xsNew[i] = xs[i];
+		}
+		delete []positions;
+		delete []xs;
+		positions = positionsNew;
+		xs = xsNew;
+		size = sizeNew;
+	}
+	positions[len] = position;
+	xs[len] = x;
+	len++;
+}
+
+void LineCheckpoints::InvalidateFrom(int position) {
+	// A change may complete or break a UTF-8 character which started up to
+	// 3 bytes earlier, altering its width, so keep a small distance.
+	while ((len > 1) && (positions[len - 1] > position - 4)) {
+		len--;
+	}
+}
+
+// Find the last checkpoint at or before a position.
+int LineCheckpoints::FindPosition(int position) const {
+	int lower = 0;
+	int upper = len - 1;
+	while (lower < upper) {
+		int middle = (upper + lower + 1) / 2; 	// Round high
+		if (position < positions[middle]) {
+			upper = middle - 1;
+		} else {
+			lower = middle;
+		}
+	}
+	return lower;
+}
+
+// Find the last checkpoint at or before an x position.
+int LineCheckpoints::FindX(int x) const {
+	int lower = 0;
+	int upper = len - 1;
+	while (lower < upper) {
+		int middle = (upper + lower + 1) / 2; 	// Round high
+		if (x < xs[middle]) {
+			upper = middle - 1;
+		} else {
+			lower = middle;
+		}
+	}
+	return lower;
+}
+
 LineLayoutCache::LineLayoutCache() :
 	level(0), length(0), size(0), cache(0),
-	allInvalidated(false), styleClock(-1), useCount(0) {
+	allInvalidated(false), styleClock(-1), useCount(0), checkpointsClock(0), generation(0) {
 	Allocate(0);
 }
 
@@ -268,6 +364,7 @@ void LineLayoutCache::Deallocate() {
 }
 
 void LineLayoutCache::Invalidate(LineLayout::validLevel validity_) {
+	generation++;
 	if (cache && !allInvalidated) {
 		for (int i = 0; i < length; i++) {
 			if (cache[i]) {
@@ -278,6 +375,11 @@ void LineLayoutCache::Invalidate(LineLayout::validLevel validity_) {
 			allInvalidated = true;
 		}
 	}
+	if (validity_ == LineLayout::llInvalid) {
+		for (int i = 0; i < lengthCheckpointCache; i++) {
+			checkpoints[i].Clear();
+		}
+	}
 }
 
 void LineLayoutCache::SetLevel(int level_) {
@@ -350,6 +452,40 @@ void LineLayoutCache::Dispose(LineLayout *ll) {
 	}
 }
 
+LineCheckpoints *LineLayoutCache::RetrieveCheckpoints(int lineNumber) {
+	checkpointsClock++;
+	LineCheckpoints *ret = &checkpoints[0];
+	for (int i = 0; i < lengthCheckpointCache; i++) {
+		if (checkpoints[i].lineNumber == lineNumber) {
+			checkpoints[i].clock = checkpointsClock;
+			return &checkpoints[i];
+		}
+		if (checkpoints[i].clock < ret->clock) {
+			ret = &checkpoints[i];
+		}
+	}
+	// Reuse the least recently used entry
+	ret->Clear();
+	ret->lineNumber = lineNumber;
+	ret->clock = checkpointsClock;
+	return ret;
+}
+
+/**
+ * Text or styles changed from @a offsetInLine in @a lineFirst up to @a lineLast
+ * so any checkpoints after the change are no longer valid.
+ */
+void LineLayoutCache::InvalidateCheckpoints(int lineFirst, int offsetInLine, int lineLast) {
+	for (int i = 0; i < lengthCheckpointCache; i++) {
+		if (checkpoints[i].lineNumber == lineFirst) {
+			checkpoints[i].InvalidateFrom(offsetInLine);
+		} else if ((checkpoints[i].lineNumber > lineFirst) && (checkpoints[i].lineNumber <= lineLast)) {
+			checkpoints[i].Clear();
+			checkpoints[i].lineNumber = -1;
+		}
+	}
+}
+
 void BreakFinder::Insert(int val) {
 	// Expand if needed
 	if (saeLen >= saeSize) {
@@ -423,7 +559,10 @@ BreakFinder::BreakFinder(LineLayout *ll_, int lineStart_, int lineEnd_, int posL
 		SelectionPosition posStart(posLineStart);
 		SelectionPosition posEnd(posLineStart + lineEnd);
 		SelectionSegment segmentLine(posStart, posEnd);
-		for (size_t r=0; r<ll->psel->Count(); r++) {
+		size_t rangeFirst;
+		size_t rangeLast;
+		ll->psel->RangesNear(posLineStart, posLineStart + lineEnd, rangeFirst, rangeLast);
+		for (size_t r=rangeFirst; r<rangeLast; r++) {
 			SelectionSegment portion = ll->psel->Range(r).Intersect(segmentLine);
 			if (!(portion.start == portion.end)) {
 				if (portion.start.IsValid())
@@ -28,6 +28,8 @@ private:
 	bool inCache;
 public:
 	enum { wrapWidthInfinite = 0x7ffffff };
+	// Unwrapped lines longer than this are laid out in windows.
+	enum { lengthStartWindow = 10000 };
 	int maxLineLength;
 	int numCharsInLine;
 	int numCharsBeforeEOL;
@@ -53,6 +55,12 @@ public:
 	int lines;
 	int wrapIndent; // In pixels
 
+	// Windowed layout support: very long unwrapped lines are only laid out
+	// around the visible part, chars[0] being at windowStart in the document line.
+	bool windowed;
+	int windowStart;
+	int xWindowStart; // In pixels
+
 	LineLayout(int maxLineLength_);
 	virtual ~LineLayout();
 	void Resize(int maxLineLength_);
@@ -67,6 +75,38 @@ public:
 	void RestoreBracesHighlight(Range rangeLine, Position braces[], bool ignoreStyle);
 	int FindBefore(int x, int lower, int upper) const;
 	int EndLineStyle() const;
+	int SubLineStart(int line) const;
+	void SetWindow(int windowStart_, int xWindowStart_);
+	void ClearWindow();
+};
+
+/**
+ * The x position at regular intervals along a very long line, so a window of the
+ * line can be laid out without measuring all of the text before it.
+ */
+class LineCheckpoints {
+	int *positions;
+	int *xs;
+	int size;
+public:
+	enum { checkpointInterval = 1000 };
+	int lineNumber;
+	int len;
+	unsigned int clock;
+
+	LineCheckpoints();
+	~LineCheckpoints();
+	void Clear();
+	void Add(int position, int x);
+	void InvalidateFrom(int position);
+	int Position(int checkpoint) const {
+		return positions[checkpoint];
+	}
+	int X(int checkpoint) const {
+		return xs[checkpoint];
+	}
+	int FindPosition(int position) const;
+	int FindX(int x) const;
 };
 
 /**
@@ -79,6 +119,10 @@ class LineLayoutCache {
 	bool allInvalidated;
 	int styleClock;
 	int useCount;
+	enum { lengthCheckpointCache = 4 };
+	LineCheckpoints checkpoints[lengthCheckpointCache];
+	unsigned int checkpointsClock;
+	unsigned int generation;	///< Changes whenever layouts are invalidated
 	void Allocate(int length_);
 	void AllocateForLevel(int linesOnScreen, int linesInDoc);
 public:
@@ -92,11 +136,14 @@ public:
 		llcDocument=SC_CACHE_DOCUMENT
 	};
 	void Invalidate(LineLayout::validLevel validity_);
+	unsigned int Generation() const { return generation; }
 	void SetLevel(int level_);
 	int GetLevel() const { return level; }
 	LineLayout *Retrieve(int lineNumber, int lineCaret, int maxChars, int styleClock_,
 		int linesOnScreen, int linesInDoc);
 	void Dispose(LineLayout *ll);
+	LineCheckpoints *RetrieveCheckpoints(int lineNumber);
+	void InvalidateCheckpoints(int lineFirst, int offsetInLine, int lineLast);
 };
 
 class PositionCacheEntry {
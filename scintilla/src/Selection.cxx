@@ -160,7 +160,7 @@ void SelectionRange::MinimizeVirtualSpace() {
 	}
 }
 
-Selection::Selection() : mainRange(0), moveExtends(false), tentativeMain(false), selType(selStream) {
+Selection::Selection() : mainRange(0), moveExtends(false), tentativeMain(false), linesOrdered(false), selType(selStream) {
 	AddSelection(SelectionPosition(0));
 }
 
@@ -186,6 +186,11 @@ SelectionRange &Selection::Rectangular() {
 SelectionSegment Selection::Limits() const {
 	if (ranges.empty()) {
 		return SelectionSegment();
+	} else if (LinesOrdered()) {
+		SelectionSegment sr(ranges.front().anchor, ranges.front().caret);
+		sr.Extend(ranges.back().anchor);
+		sr.Extend(ranges.back().caret);
+		return sr;
 	} else {
 		SelectionSegment sr(ranges[0].anchor, ranges[0].caret);
 		for (size_t i=1; i<ranges.size(); i++) {
@@ -233,6 +238,66 @@ void Selection::SetMoveExtends(bool moveExtends_) {
 	moveExtends = moveExtends_;
 }
 
+bool Selection::LinesOrdered() const {
+	return linesOrdered && IsRectangular();
+}
+
+// Called after building a rectangular selection from its anchor line to its caret line.
+// Edits keep the ranges in order so only adding or setting ranges clears this.
+void Selection::SetLinesOrdered(bool linesOrdered_) {
+	linesOrdered = linesOrdered_;
+}
+
+/**
+ * Find the indexes [rangeFirst, rangeLast) of the ranges that may touch positions start
+ * to end inclusive. Ranges in line order are found by binary search so drawing a few
+ * lines of a large rectangular selection does not look at every range.
+ */
+void Selection::RangesNear(int start, int end, size_t &rangeFirst, size_t &rangeLast) const {
+	rangeFirst = 0;
+	rangeLast = ranges.size();
+	if (!LinesOrdered() || (ranges.size() < 2))
+		return;
+	const bool descending = ranges.back().Start() < ranges.front().Start();
+	const size_t count = ranges.size();
+	// Positions of the ranges rise with i when indexed in document order
+	size_t lower = 0;
+	size_t upper = count;
+	while (lower < upper) {
+		size_t middle = (lower + upper) / 2;
+		const SelectionRange &range = ranges[descending ? count - 1 - middle : middle];
+		if (range.End().Position() < start)
+			lower = middle + 1;
+		else
+			upper = middle;
+	}
+	const size_t first = lower;
+	upper = count;
+	while (lower < upper) {
+		size_t middle = (lower + upper) / 2;
+		const SelectionRange &range = ranges[descending ? count - 1 - middle : middle];
+		if (range.Start().Position() <= end)
+			lower = middle + 1;
+		else
+			upper = middle;
+	}
+	const size_t last = lower;
+	if (descending) {
+		rangeFirst = count - last;
+		rangeLast = count - first;
+	} else {
+		rangeFirst = first;
+		rangeLast = last;
+	}
+}
+
+// Keep the first count ranges with the last of them being main.
+void Selection::TruncateRanges(size_t count) {
+	PLATFORM_ASSERT((count > 0) && (count <= ranges.size()));
+	ranges.resize(count, SelectionRange());
+	mainRange = count - 1;
+}
+
 bool Selection::Empty() const {
 	for (size_t i=0; i<ranges.size(); i++) {
 		if (!ranges[i].Empty())
@@ -284,18 +349,21 @@ void Selection::TrimSelection(SelectionRange range) {
 }
 
 void Selection::SetSelection(SelectionRange range) {
+	linesOrdered = false;
 	ranges.clear();
 	ranges.push_back(range);
 	mainRange = ranges.size() - 1;
 }
 
 void Selection::AddSelection(SelectionRange range) {
+	linesOrdered = false;
 	TrimSelection(range);
 	ranges.push_back(range);
 	mainRange = ranges.size() - 1;
 }
 
 void Selection::AddSelectionWithoutTrim(SelectionRange range) {
+	linesOrdered = false;
 	ranges.push_back(range);
 	mainRange = ranges.size() - 1;
 }
@@ -316,7 +384,10 @@ void Selection::CommitTentative() {
 }
 
 int Selection::CharacterInSelection(int posCharacter) const {
-	for (size_t i=0; i<ranges.size(); i++) {
+	size_t rangeFirst;
+	size_t rangeLast;
+	RangesNear(posCharacter, posCharacter, rangeFirst, rangeLast);
+	for (size_t i=rangeFirst; i<rangeLast; i++) {
 		if (ranges[i].ContainsCharacter(posCharacter))
 			return i == mainRange ? 1 : 2;
 	}
@@ -324,7 +395,10 @@ int Selection::CharacterInSelection(int posCharacter) const {
 }
 
 int Selection::InSelectionForEOL(int pos) const {
-	for (size_t i=0; i<ranges.size(); i++) {
+	size_t rangeFirst;
+	size_t rangeLast;
+	RangesNear(pos, pos, rangeFirst, rangeLast);
+	for (size_t i=rangeFirst; i<rangeLast; i++) {
 		if (!ranges[i].Empty() && (pos > ranges[i].Start().Position()) && (pos <= ranges[i].End().Position()))
 			return i == mainRange ? 1 : 2;
 	}
@@ -333,7 +407,10 @@ int Selection::InSelectionForEOL(int pos) const {
 
 int Selection::VirtualSpaceFor(int pos) const {
 	int virtualSpace = 0;
-	for (size_t i=0; i<ranges.size(); i++) {
+	size_t rangeFirst;
+	size_t rangeLast;
+	RangesNear(pos, pos, rangeFirst, rangeLast);
+	for (size_t i=rangeFirst; i<rangeLast; i++) {
 		if ((ranges[i].caret.Position() == pos) && (virtualSpace < ranges[i].caret.VirtualSpace()))
 			virtualSpace = ranges[i].caret.VirtualSpace();
 		if ((ranges[i].anchor.Position() == pos) && (virtualSpace < ranges[i].anchor.VirtualSpace()))
@@ -343,6 +420,7 @@ int Selection::VirtualSpaceFor(int pos) const {
 }
 
 void Selection::Clear() {
+	linesOrdered = false;
 	ranges.clear();
 	ranges.push_back(SelectionRange());
 	mainRange = ranges.size() - 1;
@@ -353,11 +431,15 @@ void Selection::Clear() {
 }
 
 void Selection::RemoveDuplicates() {
+	// Ranges in line order only equal neighbours at the same position
+	const bool ordered = LinesOrdered();
 	for (size_t i=0; i<ranges.size()-1; i++) {
 		if (ranges[i].Empty()) {
 			size_t j=i+1;
 			while (j<ranges.size()) {
-				if (ranges[i] == ranges[j]) {
+				if (ordered && (ranges[j].Start().Position() != ranges[i].Start().Position())) {
+					break;
+				} else if (ranges[i] == ranges[j]) {
 					ranges.erase(ranges.begin() + j);
 					if (mainRange >= j)
 						mainRange--;
@@ -137,6 +137,7 @@ class Selection {
 	size_t mainRange;
 	bool moveExtends;
 	bool tentativeMain;
+	bool linesOrdered;	///< The ranges are one per line in line order, as built for a rectangle
 public:
 	enum selTypes { noSel, selStream, selRectangle, selLines, selThin };
 	selTypes selType;
@@ -159,6 +160,10 @@ public:
 	SelectionRange &RangeMain();
 	bool MoveExtends() const;
 	void SetMoveExtends(bool moveExtends_);
+	bool LinesOrdered() const;
+	void SetLinesOrdered(bool linesOrdered_);
+	void RangesNear(int start, int end, size_t &rangeFirst, size_t &rangeLast) const;
+	void TruncateRanges(size_t count);
 	bool Empty() const;
 	SelectionPosition Last() const;
 	int Length() const;
@@ -174,8 +174,10 @@ public:
 			}
 			RoomFor(insertLength);
 			GapTo(position);
+			// A local pointer as stores through body may alias the members when T is char
+			T *gap = body + part1Length;
 			for (int i = 0; i < insertLength; i++)
-				body[part1Length + i] = v;
+				gap[i] = v;
 			lengthBody += insertLength;
 			part1Length += insertLength;
 			gapLength -= insertLength;
@@ -255,6 +257,27 @@ public:
 		memcpy(buffer, body + position, range2Length * sizeof(T));
 	}
 
+	/// Retrieve the elements in place as the part before the gap and the part after it.
+	void GetParts(const T **part1, int *length1, const T **part2, int *length2) const {
+		*part1 = body;
+		*length1 = part1Length;
+		*part2 = body ? body + part1Length + gapLength : 0;
+		*length2 = lengthBody - part1Length;
+	}
+
+	/// Continue with a copy of the contents and return the previous allocation
+	/// which the caller must then delete [].
+	T *DetachBody() {
+		T *previous = body;
+		if (body) {
+			body = new T[size];
+			memcpy(body, previous, sizeof(T) * part1Length);
+			memcpy(body + part1Length + gapLength, previous + part1Length + gapLength,
+				sizeof(T) * (lengthBody - part1Length));
+		}
+		return previous;
+	}
+
 	T *BufferPointer() {
 		RoomFor(1);
 		GapTo(lengthBody);
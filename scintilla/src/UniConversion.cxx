@@ -6,6 +6,7 @@
 // The License.txt file describes the conditions under which this software may be distributed.
 
 #include <stdlib.h>
+#include <string.h>
 
 #include "UniConversion.h"
 
@@ -13,6 +14,22 @@ enum { SURROGATE_LEAD_FIRST = 0xD800 };
 enum { SURROGATE_TRAIL_FIRST = 0xDC00 };
 enum { SURROGATE_TRAIL_LAST = 0xDFFF };
 
+// Length of the run of ASCII bytes at the start of us, checked a machine word at a time
+static unsigned int ASCIIRun(const unsigned char *us, unsigned int len) {
+	const unsigned long highBits = ~0UL / 0xFF * 0x80;
+	unsigned int i = 0;
+	while (i + sizeof(unsigned long) <= len) {
+		unsigned long word;
+		memcpy(&word, us + i, sizeof(word));
+		if (word & highBits)
+			break;
+		i += sizeof(word);
+	}
+	while ((i < len) && (us[i] < 0x80))
+		i++;
+	return i;
+}
+
 unsigned int UTF8Length(const wchar_t *uptr, unsigned int tlen) {
 	unsigned int len = 0;
 	for (unsigned int i = 0; i < tlen && uptr[i];) {
@@ -74,12 +91,14 @@ unsigned int UTF8CharLength(unsigned char ch) {
 }
 
 unsigned int UTF16Length(const char *s, unsigned int len) {
+	const unsigned char *us = reinterpret_cast<const unsigned char *>(s);
 	unsigned int ulen = 0;
 	unsigned int charLen;
 	for (unsigned int i=0; i<len;) {
-		unsigned char ch = static_cast<unsigned char>(s[i]);
+		unsigned char ch = us[i];
 		if (ch < 0x80) {
-			charLen = 1;
+			charLen = ASCIIRun(us + i, len - i);
+			ulen += charLen - 1;
 		} else if (ch < 0x80 + 0x40 + 0x20) {
 			charLen = 2;
 		} else if (ch < 0x80 + 0x40 + 0x20 + 0x10) {
@@ -99,10 +118,19 @@ unsigned int UTF16FromUTF8(const char *s, unsigned int len, wchar_t *tbuf, unsig
 	const unsigned char *us = reinterpret_cast<const unsigned char *>(s);
 	unsigned int i=0;
 	while ((i<len) && (ui<tlen)) {
+		if (us[i] < 0x80) {
+			unsigned int run = ASCIIRun(us + i, len - i);
+			if (run > tlen - ui)
+				run = tlen - ui;
+			for (unsigned int j = 0; j < run; j++) {
+				tbuf[ui + j] = us[i + j];
+			}
+			i += run;
+			ui += run;
+			continue;
+		}
 		unsigned char ch = us[i++];
-		if (ch < 0x80) {
-			tbuf[ui] = ch;
-		} else if (ch < 0x80 + 0x40 + 0x20) {
+		if (ch < 0x80 + 0x40 + 0x20) {
 			tbuf[ui] = static_cast<wchar_t>((ch & 0x1F) << 6);
 			ch = us[i++];
 			tbuf[ui] = static_cast<wchar_t>(tbuf[ui] + (ch & 0x7F));
@@ -129,3 +157,60 @@ unsigned int UTF16FromUTF8(const char *s, unsigned int len, wchar_t *tbuf, unsig
 	}
 	return ui;
 }
+
+/**
+ * Check that s holds well-formed UTF-8: no overlong forms, surrogates, code points
+ * beyond 0x10FFFF or truncated characters. Runs of ASCII are checked a word at a time.
+ * Returns the length of the valid prefix which is len when all of s is valid and
+ * sets *characters, if not NULL, to the number of characters in that prefix.
+ */
+unsigned int UTF8Validate(const char *s, unsigned int len, unsigned int *characters) {
+	const unsigned char *us = reinterpret_cast<const unsigned char *>(s);
+	unsigned int count = 0;
+	unsigned int i = 0;
+	while (i < len) {
+		const unsigned char ch = us[i];
+		if (ch < 0x80) {
+			const unsigned int run = ASCIIRun(us + i, len - i);
+			i += run;
+			count += run;
+			continue;
+		}
+		unsigned int charLen;
+		unsigned char trailMin = 0x80;
+		unsigned char trailMax = 0xBF;
+		if (ch < 0xC2) {
+			break;	// Trail byte or overlong 2 byte form
+		} else if (ch < 0xE0) {
+			charLen = 2;
+		} else if (ch < 0xF0) {
+			charLen = 3;
+			if (ch == 0xE0)
+				trailMin = 0xA0;	// Overlong
+			else if (ch == 0xED)
+				trailMax = 0x9F;	// Surrogate
+		} else if (ch < 0xF5) {
+			charLen = 4;
+			if (ch == 0xF0)
+				trailMin = 0x90;	// Overlong
+			else if (ch == 0xF4)
+				trailMax = 0x8F;	// Beyond 0x10FFFF
+		} else {
+			break;
+		}
+		if (charLen > len - i)
+			break;
+		if ((us[i+1] < trailMin) || (us[i+1] > trailMax))
+			break;
+		unsigned int trail = 2;
+		while ((trail < charLen) && ((us[i+trail] & 0xC0) == 0x80))
+			trail++;
+		if (trail < charLen)
+			break;
+		i += charLen;
+		count++;
+	}
+	if (characters)
+		*characters = count;
+	return i;
+}
@@ -0,0 +1,234 @@
+// Scintilla source code edit control
+/** @file IncrementalLex.cxx
+ ** Checks that restyling after an edit gives the same styles as lexing from scratch.
+ **/
+// Copyright 1998-2011 by Neil Hodgson <neilh@scintilla.org>
+// The License.txt file describes the conditions under which this software may be distributed.
+
+// Usage: incrementallex [-v]
+// Each case loads its text into a document and styles it. Then, for every position, a
+// few characters are inserted and removed again and the character there is deleted and
+// restored. After each change the document is restyled as an editor would, first up to
+// two lines past the change and then to the end, and its styles are compared with those
+// of a new document holding the same text. The number of mismatched edits is written to
+// stdout and the exit status is 1 if there are any.
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
+#include "Platform.h"
+
+#include "ILexer.h"
+#include "Scintilla.h"
+#include "SciLexer.h"
+
+#include "LexerModule.h"
+#include "Catalogue.h"
+#include "SplitVector.h"
+#include "Partitioning.h"
+#include "RunStyles.h"
+#include "CellBuffer.h"
+#include "PerLine.h"
+#include "CharClassify.h"
+#include "Decoration.h"
+#include "Document.h"
+
+#ifdef SCI_NAMESPACE
+using namespace Scintilla;
+#endif
+
+// Attaches a lexer to a document as ScintillaBase does without needing a window.
+class TestLexInterface : public LexInterface {
+public:
+	TestLexInterface(Document *pdoc_, ILexer *instance_) : LexInterface(pdoc_) {
+		instance = instance_;
+	}
+	~TestLexInterface() {
+		instance->Release();
+	}
+};
+
+struct Case {
+	const char *name;
+	int language;
+	const char *properties[4];	///< Pairs of key and value ending with 0
+	const char *text;
+	const char *insertions;	///< Each character is inserted at every position
+};
+
+static const Case cases[] = {
+	{
+		"php heredoc", SCLEX_HTML, { 0 },
+		"<?php\n"
+		"$a = <<<EOT\n"
+		"text $b\n"
+		"EOT;\n"
+		"$c = 'd';\n"
+		"$e = <<<\"EOS\"\n"
+		"more\n"
+		"EOS;\n"
+		"?>\n"
+		"<p>end</p>\n",
+		"x;\n"
+	},
+	{
+		"ruby heredoc", SCLEX_RUBY, { 0 },
+		"a = <<EOS\n"
+		"text\n"
+		"EOS\n"
+		"b = 'c'\n"
+		"puts a\n",
+		"x\n"
+	},
+	{
+		"cpp preprocessor", SCLEX_CPP, { "lexer.cpp.track.preprocessor", "1", 0 },
+		"#define A 1\n"
+		"#undef A\n"
+		"#define A 0\n"
+		"#if A\n"
+		"int on;\n"
+		"#else\n"
+		"int off;\n"
+		"#endif\n"
+		"#ifdef A\n"
+		"int defined;\n"
+		"#endif\n"
+		"/* comment\n"
+		"   continues */\n"
+		"const char *s = \"str\";\n"
+		"const char *r = R\"x(raw\n"
+		")x\";\n",
+		"x\n\"/#"
+	},
+	{
+		"cpp regex and raw string", SCLEX_CPP, { 0 },
+		"a = b;\n"
+		"/re/.test(c);\n"
+		"d = e\n"
+		"/ f;\n"
+		"const char *r = R\"y(one\n"
+		")\"\n"
+		")y\";\n"
+		"g();\n",
+		"x\n/(\")"
+	},
+};
+
+static void SetUp(Document *pdoc, const Case &c) {
+	const LexerModule *lex = Catalogue::Find(c.language);
+	ILexer *instance = lex->Create();
+	for (int i = 0; c.properties[i]; i += 2) {
+		instance->PropertySet(c.properties[i], c.properties[i + 1]);
+	}
+	pdoc->SetStylingBits(lex->GetStyleBitsNeeded());
+	pdoc->pli = new TestLexInterface(pdoc, instance);
+}
+
+static std::string Styles(Document *pdoc) {
+	std::string styles;
+	for (int pos = 0; pos < pdoc->Length(); pos++) {
+		styles += pdoc->StyleAt(pos);
+	}
+	return styles;
+}
+
+static std::string Text(Document *pdoc) {
+	std::string text;
+	for (int pos = 0; pos < pdoc->Length(); pos++) {
+		text += pdoc->CharAt(pos);
+	}
+	return text;
+}
+
+// Restyle the way an editor does after a change at pos: the view around the change
+// then, when idle, the rest of the document.
+static void Restyle(Document *pdoc, int pos) {
+	pdoc->EnsureStyledTo(pdoc->LineStart(pdoc->LineFromPosition(pos) + 2));
+	pdoc->EnsureStyledTo(pdoc->Length());
+}
+
+// Returns the first position styled differently from a new document or -1.
+static int FirstMismatch(Document *pdoc, const Case &c) {
+	Document *pdocFresh = new Document();
+	pdocFresh->AddRef();
+	SetUp(pdocFresh, c);
+	const std::string text = Text(pdoc);
+	pdocFresh->InsertString(0, text.c_str(), static_cast<int>(text.length()));
+	pdocFresh->EnsureStyledTo(pdocFresh->Length());
+	const std::string expected = Styles(pdocFresh);
+	pdocFresh->Release();
+	const std::string styles = Styles(pdoc);
+	for (size_t pos = 0; pos < expected.length(); pos++) {
+		if (styles[pos] != expected[pos])
+			return static_cast<int>(pos);
+	}
+	return -1;
+}
+
+static const char *Describe(char ch) {
+	static char s[2];
+	if (ch == '\n')
+		return "nl";
+	s[0] = ch;
+	s[1] = '\0';
+	return s;
+}
+
+static int Check(Document *pdoc, const Case &c, const char *action, char ch, int pos, bool verbose) {
+	const int mismatch = FirstMismatch(pdoc, c);
+	if (mismatch < 0)
+		return 0;
+	if (verbose)
+		printf("%s: %s %s at %d mismatches at %d\n", c.name, action, Describe(ch), pos, mismatch);
+	// Restyle everything so the next edit starts from the right styles
+	pdoc->ModifiedAt(0);
+	pdoc->EnsureStyledTo(pdoc->Length());
+	return 1;
+}
+
+static int RunCase(const Case &c, bool verbose) {
+	Document *pdoc = new Document();
+	pdoc->AddRef();
+	pdoc->SetUndoCollection(false);
+	SetUp(pdoc, c);
+	const int length = static_cast<int>(strlen(c.text));
+	pdoc->InsertString(0, c.text, length);
+	pdoc->EnsureStyledTo(pdoc->Length());
+	int failures = 0;
+	for (int pos = 0; pos <= length; pos++) {
+		for (const char *ins = c.insertions; *ins; ins++) {
+			pdoc->InsertString(pos, ins, 1);
+			Restyle(pdoc, pos);
+			failures += Check(pdoc, c, "insert", *ins, pos, verbose);
+			pdoc->DeleteChars(pos, 1);
+			Restyle(pdoc, pos);
+			failures += Check(pdoc, c, "remove inserted", *ins, pos, verbose);
+		}
+		if (pos < length) {
+			const char ch = pdoc->CharAt(pos);
+			pdoc->DeleteChars(pos, 1);
+			Restyle(pdoc, pos);
+			failures += Check(pdoc, c, "delete", ch, pos, verbose);
+			pdoc->InsertString(pos, &ch, 1);
+			Restyle(pdoc, pos);
+			failures += Check(pdoc, c, "restore", ch, pos, verbose);
+		}
+	}
+	pdoc->Release();
+	return failures;
+}
+
+int main(int argc, char *argv[]) {
+	const bool verbose = (argc > 1) && (0 == strcmp(argv[1], "-v"));
+	int failures = 0;
+	for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+		const int failuresCase = RunCase(cases[i], verbose);
+		printf("%s\t%d\n", cases[i].name, failuresCase);
+		failures += failuresCase;
+	}
+	return failures ? 1 : 0;
+}
@@ -391,6 +391,7 @@ static void init_doc_struct(GeanyDocument *new_doc)
 	priv->undo_actions = NULL;
 	priv->redo_actions = NULL;
 	priv->line_count = 0;
+	priv->styled_wait_line = -1;
 	priv->tag_list_update_source = 0;
 #ifndef USE_GIO_FILEMON
 	priv->last_check = time(NULL);
@@ -2257,14 +2258,12 @@ static gboolean update_tags_from_buffer(GeanyDocument *doc)
 		/* old code */
 		result = tm_source_file_update(doc->tm_file, TRUE, FALSE, TRUE);
 #else
-		gsize len = sci_get_length(doc->editor->sci) + 1;
-		gchar *text = g_malloc(len);
+		/* the parser only reads the buffer so a snapshot of the text avoids copying it */
+		const struct Sci_TextSnapshot *snapshot = sci_create_text_snapshot(doc->editor->sci);
 
-		/* we copy the whole text into memory instead using a direct char pointer from
-		 * Scintilla because tm_source_file_buffer_update() does modify the string slightly */
-		sci_get_text(doc->editor->sci, len, text);
-		result = tm_source_file_buffer_update(doc->tm_file, (guchar*) text, len, TRUE);
-		g_free(text);
+		result = tm_source_file_buffer_update(doc->tm_file, (guchar*) snapshot->text,
+			snapshot->length + 1, TRUE);
+		sci_release_text_snapshot(doc->editor->sci, snapshot);
 #endif
 	return result;
 }
@@ -108,6 +108,8 @@ static void auto_multiline(GeanyEditor *editor, gint pos);
 static void auto_close_chars(ScintillaObject *sci, gint pos, gchar c);
 static void close_block(GeanyEditor *editor, gint pos);
 static void editor_highlight_braces(GeanyEditor *editor, gint cur_pos);
+static gboolean on_editor_notify(GObject *object, GeanyEditor *editor,
+								 SCNotification *nt, gpointer data);
 static void read_current_word(GeanyEditor *editor, gint pos, gchar *word, gsize wordlen,
 		const gchar *wc, gboolean stem);
 static gsize count_indent_size(GeanyEditor *editor, const gchar *base_indent);
@@ -508,6 +510,28 @@ static void on_margin_click(GeanyEditor *editor, SCNotification *nt)
 }
 
 
+/* Scintilla styles the text after the view while idle and reports how far it has got.
+ * Fold levels are only accurate for lines that have been styled. */
+static void on_styled(GeanyEditor *editor, gint position)
+{
+	GeanyDocument *doc = editor->document;
+	gint line = doc->priv->styled_wait_line;
+
+	/* the function and statusbar shown are for the current document only */
+	if (line < 0 || doc != document_get_current())
+		return;
+	if (position < sci_get_length(editor->sci) &&
+		sci_get_line_from_position(editor->sci, position) <= line)
+		return;
+
+	doc->priv->styled_wait_line = -1;
+	/* now that the current line is styled its fold points are accurate,
+	 * so force an update of the current function/tag. */
+	symbols_get_current_function(NULL, NULL);
+	ui_update_statusbar(NULL, -1);
+}
+
+
 static void on_update_ui(GeanyEditor *editor, G_GNUC_UNUSED SCNotification *nt)
 {
 	ScintillaObject *sci = editor->sci;
@@ -518,6 +542,10 @@ static void on_update_ui(GeanyEditor *editor, G_GNUC_UNUSED SCNotification *nt)
 	if (! (nt->updated & SC_UPDATE_CONTENT) && ! (nt->updated & SC_UPDATE_SELECTION))
 		return;
 
+	/* if still waiting for styling, wait for the line the caret is now on instead */
+	if (editor->document->priv->styled_wait_line >= 0)
+		editor->document->priv->styled_wait_line = sci_get_current_line(sci);
+
 	/* undo / redo menu update */
 	ui_update_popup_reundo_items(editor->document);
 
@@ -983,16 +1011,51 @@ static gboolean check_partial_completion(GeanyEditor *editor, const gchar *entry
 }
 
 
+/* In debug mode, paints slower than this many microseconds are logged with where the
+ * time went, to help spot rendering regressions. */
+#define SLOW_PAINT_TIME 50000
+
+static void log_paint_statistics(ScintillaObject *sci)
+{
+	gint paint_time = SSM(sci, SCI_GETPAINTSTATISTIC, SC_PAINTSTAT_PAINTTIME, 0);
+
+	if (paint_time < SLOW_PAINT_TIME)
+		return;
+
+	geany_debug("Slow paint: %d us (styling %d us for %d bytes, wrapping %d us for %d lines, "
+		"layout %d us of which measuring %d us for %d lines with %d cached, drawing %d us for %d lines)",
+		paint_time,
+		(gint) SSM(sci, SCI_GETPAINTSTATISTIC, SC_PAINTSTAT_STYLETIME, 0),
+		(gint) SSM(sci, SCI_GETPAINTSTATISTIC, SC_PAINTSTAT_BYTESSTYLED, 0),
+		(gint) SSM(sci, SCI_GETPAINTSTATISTIC, SC_PAINTSTAT_WRAPTIME, 0),
+		(gint) SSM(sci, SCI_GETPAINTSTATISTIC, SC_PAINTSTAT_LINESWRAPPED, 0),
+		(gint) SSM(sci, SCI_GETPAINTSTATISTIC, SC_PAINTSTAT_LAYOUTTIME, 0),
+		(gint) SSM(sci, SCI_GETPAINTSTATISTIC, SC_PAINTSTAT_MEASURETIME, 0),
+		(gint) SSM(sci, SCI_GETPAINTSTATISTIC, SC_PAINTSTAT_LINESLAIDOUT, 0),
+		(gint) SSM(sci, SCI_GETPAINTSTATISTIC, SC_PAINTSTAT_LAYOUTCACHEHITS, 0),
+		(gint) SSM(sci, SCI_GETPAINTSTATISTIC, SC_PAINTSTAT_DRAWTIME, 0),
+		(gint) SSM(sci, SCI_GETPAINTSTATISTIC, SC_PAINTSTAT_LINESDRAWN, 0));
+}
+
+
 /* Callback for the "sci-notify" signal to emit a "editor-notify" signal.
  * Plugins can connect to the "editor-notify" signal. */
 void editor_sci_notify_cb(G_GNUC_UNUSED GtkWidget *widget, G_GNUC_UNUSED gint scn,
 						  gpointer scnt, gpointer data)
 {
 	GeanyEditor *editor = data;
+	SCNotification *nt = scnt;
 	gboolean retval;
 
 	g_return_if_fail(editor != NULL);
 
+	/* plugins already saw each change of the undo group this summarises */
+	if (nt->nmhdr.code == SCN_MODIFIED && (nt->modificationType & SC_MOD_COALESCED))
+	{
+		on_editor_notify(geany_object, editor, nt, NULL);
+		return;
+	}
+
 	g_signal_emit_by_name(geany_object, "editor-notify", editor, scnt, &retval);
 }
 
@@ -1002,6 +1065,7 @@ static gboolean on_editor_notify(G_GNUC_UNUSED GObject *object, GeanyEditor *edi
 {
 	ScintillaObject *sci = editor->sci;
 	GeanyDocument *doc = editor->document;
+	gboolean text_changed;
 
 	switch (nt->nmhdr.code)
 	{
@@ -1025,6 +1089,10 @@ static gboolean on_editor_notify(G_GNUC_UNUSED GObject *object, GeanyEditor *edi
 			on_update_ui(editor, nt);
 			break;
 
+		case SCN_STYLED:
+			on_styled(editor, nt->position);
+			break;
+
 		case SCN_PAINTED:
 			/* Visible lines are only laid out accurately just before painting,
 			 * so we need to only call editor_scroll_to_line here, because the document
@@ -1042,8 +1110,17 @@ static gboolean on_editor_notify(G_GNUC_UNUSED GObject *object, GeanyEditor *edi
 			}
 			break;
 
+		case SCN_PAINTSTATISTICS:
+			/* only sent while enabled with SCI_SETPAINTSTATISTICS, in debug mode */
+			log_paint_statistics(sci);
+			break;
+
  		case SCN_MODIFIED:
-			if (editor_prefs.show_linenumber_margin && (nt->modificationType & (SC_MOD_INSERTTEXT | SC_MOD_DELETETEXT)) && nt->linesAdded)
+			/* the changes of an undo group, e.g. replace all, are summarised afterwards by
+			 * one SC_MOD_COALESCED notification, so only update once for that */
+			text_changed = (nt->modificationType & (SC_MOD_INSERTTEXT | SC_MOD_DELETETEXT)) &&
+				! (nt->modificationType & SC_COALESCEDSTEP);
+			if (editor_prefs.show_linenumber_margin && text_changed && nt->linesAdded)
 			{
 				/* automatically adjust Scintilla's line numbers margin width */
 				auto_update_margin_width(editor);
@@ -1058,7 +1135,7 @@ static gboolean on_editor_notify(G_GNUC_UNUSED GObject *object, GeanyEditor *edi
 				/* handle special fold cases, e.g. #1923350 */
 				fold_changed(sci, nt->line, nt->foldLevelNow, nt->foldLevelPrev);
 			}
-			if (nt->modificationType & (SC_MOD_INSERTTEXT | SC_MOD_DELETETEXT))
+			if (text_changed)
 			{
 				document_update_tag_list_in_idle(doc);
 			}
@@ -1484,46 +1561,16 @@ static void auto_close_chars(ScintillaObject *sci, gint pos, gchar c)
 }
 
 
-/* Finds a corresponding matching brace to the given pos
- * (this is taken from Scintilla Editor.cxx,
- * fit to work with close_block) */
+/* Finds a corresponding matching brace to the given pos, fit to work with close_block.
+ * Scintilla keeps an index of the braces in the styled text so this doesn't scan
+ * back to the opening brace each time. */
 static gint brace_match(ScintillaObject *sci, gint pos)
 {
-	gchar chBrace = sci_get_char_at(sci, pos);
-	gchar chSeek = utils_brace_opposite(chBrace);
-	gchar chAtPos;
-	gint direction = -1;
-	gint styBrace;
-	gint depth = 1;
-	gint styAtPos;
-
 	/* Hack: we need the style at @p pos but it isn't computed yet, so force styling
 	 * of this very position */
 	sci_colourise(sci, pos, pos + 1);
 
-	styBrace = sci_get_style_at(sci, pos);
-
-	if (utils_is_opening_brace(chBrace, editor_prefs.brace_match_ltgt))
-		direction = 1;
-
-	pos += direction;
-	while ((pos >= 0) && (pos < sci_get_length(sci)))
-	{
-		chAtPos = sci_get_char_at(sci, pos);
-		styAtPos = sci_get_style_at(sci, pos);
-
-		if ((pos > sci_get_end_styled(sci)) || (styAtPos == styBrace))
-		{
-			if (chAtPos == chBrace)
-				depth++;
-			if (chAtPos == chSeek)
-				depth--;
-			if (depth == 0)
-				return pos;
-		}
-		pos += direction;
-	}
-	return -1;
+	return sci_find_matching_brace(sci, pos);
 }
 
 
@@ -4584,17 +4631,22 @@ on_editor_scroll_event(GtkWidget *widget, GdkEventScroll *event, gpointer user_d
 static gboolean editor_check_colourise(GeanyEditor *editor)
 {
 	GeanyDocument *doc = editor->document;
+	ScintillaObject *sci = editor->sci;
+	gint last_line;
 
 	if (!doc->priv->colourise_needed)
 		return FALSE;
 
 	doc->priv->colourise_needed = FALSE;
-	sci_colourise(editor->sci, 0, -1);
+	/* Only lex as far as the end of the view before drawing, Scintilla styles the
+	 * rest of the document in short periods while idle (SCI_SETIDLESTYLING). */
+	last_line = SSM(sci, SCI_DOCLINEFROMVISIBLE,
+		sci_get_first_visible_line(sci) + SSM(sci, SCI_LINESONSCREEN, 0, 0), 0);
+	sci_colourise(sci, 0, sci_get_line_end_position(sci, last_line));
 
-	/* now that the current document is colourised, fold points are now accurate,
-	 * so force an update of the current function/tag. */
-	symbols_get_current_function(NULL, NULL);
-	ui_update_statusbar(NULL, -1);
+	/* update the current function/tag once the current line has been styled */
+	doc->priv->styled_wait_line = sci_get_current_line(sci);
+	on_styled(editor, sci_get_end_styled(sci));
 
 	return TRUE;
 }
@@ -4698,6 +4750,16 @@ static ScintillaObject *create_new_sci(GeanyEditor *editor)
 	/* virtual space */
 	SSM(sci, SCI_SETVIRTUALSPACEOPTIONS, editor_prefs.show_virtual_space, 0);
 
+	/* style the text after the view while idle rather than all before drawing */
+	SSM(sci, SCI_SETIDLESTYLING, SC_IDLESTYLING_AFTERVISIBLE, 0);
+
+	/* summarise the text changes of an undo group in one more SCN_MODIFIED notification */
+	SSM(sci, SCI_SETCOALESCEMODEVENTS, 1, 0);
+
+	/* measure paints so slow ones can be logged */
+	if (app->debug_mode)
+		SSM(sci, SCI_SETPAINTSTATISTICS, 1, 0);
+
 	/* only connect signals if this is for the document notebook, not split window */
 	if (editor->sci == NULL)
 	{
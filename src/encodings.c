@@ -757,6 +757,16 @@ gboolean encodings_is_unicode_charset(const gchar *string)
 }
 
 
+/* Like g_utf8_validate() with a known length but checks runs of ASCII a word at a time
+ * through Scintilla's UTF-8 support. Unlike g_utf8_validate(), NUL bytes are valid. */
+static gboolean utf8_validate(const gchar *text, gsize length)
+{
+	if (length > G_MAXUINT)
+		return g_utf8_validate(text, length, NULL);
+	return scintilla_utf8_validate(text, (guint) length, NULL) == length;
+}
+
+
 typedef struct
 {
 	gchar		*data;	/* null-terminated data */
@@ -776,7 +786,7 @@ handle_forced_encoding(BufferData *buffer, const gchar *forced_enc)
 
 	if (utils_str_equal(forced_enc, "UTF-8"))
 	{
-		if (! g_utf8_validate(buffer->data, buffer->len, NULL))
+		if (! utf8_validate(buffer->data, buffer->len))
 		{
 			return FALSE;
 		}
@@ -848,7 +858,7 @@ handle_encoding(BufferData *buffer, GeanyEncodingIndex enc_idx)
 
 			/* try UTF-8 first */
 			if (encodings_get_idx_from_charset(regex_charset) == GEANY_ENCODING_UTF_8 &&
-				(buffer->size == buffer->len) && g_utf8_validate(buffer->data, buffer->len, NULL))
+				(buffer->size == buffer->len) && utf8_validate(buffer->data, buffer->len))
 			{
 				buffer->enc = g_strdup("UTF-8");
 			}
@@ -1230,3 +1230,17 @@ gint sci_text_width(ScintillaObject *sci, gint styleNumber, const gchar *text)
 {
 	return SSM(sci, SCI_TEXTWIDTH, styleNumber, (sptr_t) text);
 }
+
+
+/* Gets the text as it is now without copying it. The snapshot does not change when the
+ * document is edited and can be read from any thread until released. */
+const struct Sci_TextSnapshot *sci_create_text_snapshot(ScintillaObject *sci)
+{
+	return (const struct Sci_TextSnapshot *) SSM(sci, SCI_CREATETEXTSNAPSHOT, 0, 0);
+}
+
+
+void sci_release_text_snapshot(ScintillaObject *sci, const struct Sci_TextSnapshot *snapshot)
+{
+	SSM(sci, SCI_RELEASETEXTSNAPSHOT, 0, (sptr_t) snapshot);
+}
@@ -183,4 +183,7 @@ void				sci_lines_split				(ScintillaObject *sci, gint pixelWidth);
 void				sci_lines_join				(ScintillaObject *sci);
 gint				sci_text_width				(ScintillaObject *sci, gint styleNumber, const gchar *text);
 
+const struct Sci_TextSnapshot *sci_create_text_snapshot	(ScintillaObject *sci);
+void				sci_release_text_snapshot	(ScintillaObject *sci, const struct Sci_TextSnapshot *snapshot);
+
 #endif